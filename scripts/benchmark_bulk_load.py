@@ -0,0 +1,126 @@
+import argparse
+import logging
+import re
+import subprocess
+import tempfile
+from pathlib import Path
+
+import numpy as np
+from utils import save_dataset_without_ground_truth, setup_logging
+
+BULK_LOAD_PATTERN = re.compile(
+    r"Bulk loaded (\d+) pages \(([\d.]+) MB\) in ([\d.]+) s: ([\d.]+) pages/s, ([\d.]+) MB/s"
+)
+
+
+def generate_dataset(
+    output_dir: Path,
+    num_points_a: int,
+    num_points_b: int,
+    num_dimensions: int,
+    rng: np.random.Generator,
+) -> None:
+    """Generate a dataset of random points, whose only use is to be indexed."""
+    A = rng.standard_normal((num_points_a, num_dimensions))
+    B = rng.standard_normal((num_points_b, num_dimensions))
+
+    save_dataset_without_ground_truth(A, B, output_dir)
+
+
+def measure_bulk_load(
+    binary: Path, dataset_dir: Path, norm_order: int, page_size: int
+) -> tuple[int, float, float, float]:
+    """Index the dataset on one thread and return the pages, seconds, pages/s and MB/s of the bulk loads of B."""
+    command = [
+        str(binary),
+        "--use-fixed-seed",
+        "index",
+        "-p",
+        str(norm_order),
+        "-d",
+        str(dataset_dir),
+        "-B",
+        str(page_size),
+        "-t",
+        "1",
+    ]
+    completed = subprocess.run(command, capture_output=True, text=True, check=True)
+
+    # On one thread, B is indexed before A, so the first report belongs to B.
+    match = BULK_LOAD_PATTERN.search(completed.stderr)
+    if match is None:
+        raise RuntimeError(f"No bulk load timing found in output:\n{completed.stderr}")
+    return (
+        int(match.group(1)),
+        float(match.group(3)),
+        float(match.group(4)),
+        float(match.group(5)),
+    )
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Measure the throughput of the B+ tree bulk loader while indexing base sets of growing sizes."
+    )
+    parser.add_argument(
+        "--binary",
+        type=Path,
+        default=Path("build/qalsh_chamfer"),
+        help="Path to the qalsh_chamfer executable",
+    )
+    parser.add_argument(
+        "--base-sizes",
+        type=int,
+        nargs="+",
+        default=[100_000, 1_000_000],
+        help="Sizes of the base set B to benchmark",
+    )
+    parser.add_argument(
+        "--num-dimensions", type=int, default=8, help="Number of dimensions"
+    )
+    parser.add_argument(
+        "--norm-order", type=int, choices=[1, 2], default=2, help="Norm order"
+    )
+    parser.add_argument("--page-size", type=int, default=4096, help="Page size")
+    parser.add_argument("--seed", type=int, default=42, help="Random seed")
+    args = parser.parse_args()
+
+    setup_logging(logging.INFO)
+    rng = np.random.default_rng(args.seed)
+
+    results = []
+    with tempfile.TemporaryDirectory() as temp_dir:
+        for num_points_b in args.base_sizes:
+            dataset_dir = Path(temp_dir) / f"n{num_points_b}"
+            # A is kept small, since only the bulk loads of B are reported.
+            generate_dataset(
+                dataset_dir, 1000, num_points_b, args.num_dimensions, rng
+            )
+            pages, seconds, pages_per_second, megabytes_per_second = (
+                measure_bulk_load(
+                    args.binary, dataset_dir, args.norm_order, args.page_size
+                )
+            )
+            logging.info(
+                f"|B| = {num_points_b}: {pages} pages in {seconds:.3f} s, "
+                f"{pages_per_second:.0f} pages/s, {megabytes_per_second:.1f} MB/s"
+            )
+            results.append(
+                (
+                    num_points_b,
+                    pages,
+                    seconds,
+                    pages_per_second,
+                    megabytes_per_second,
+                )
+            )
+
+    print(f"{'|B|':>12} {'pages':>10} {'s':>10} {'pages/s':>12} {'MB/s':>10}")
+    for num_points_b, pages, seconds, pages_per_second, megabytes_per_second in results:
+        print(
+            f"{num_points_b:>12} {pages:>10} {seconds:>10.3f} "
+            f"{pages_per_second:>12.0f} {megabytes_per_second:>10.1f}"
+        )
+
+if __name__ == "__main__":
+    main()
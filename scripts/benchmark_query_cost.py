@@ -0,0 +1,103 @@
+import argparse
+import logging
+import re
+import subprocess
+import tempfile
+from pathlib import Path
+
+import numpy as np
+from utils import save_dataset_without_ground_truth, setup_logging
+
+QUERY_TIME_PATTERN = re.compile(
+    r"Answered (\d+) queries in ([\d.]+) ms \(([\d.]+) us per query\)"
+)
+
+
+def generate_dataset(
+    output_dir: Path,
+    num_points_a: int,
+    num_points_b: int,
+    num_dimensions: int,
+    rng: np.random.Generator,
+) -> None:
+    """Generate a dataset whose queries in A all have a close neighbour in B."""
+    B = rng.standard_normal((num_points_b, num_dimensions))
+    A = B[rng.integers(0, num_points_b, num_points_a)]
+    A = A + 0.01 * rng.standard_normal(A.shape)
+
+    save_dataset_without_ground_truth(A, B, output_dir)
+
+
+def measure_query_cost(binary: Path, dataset_dir: Path, norm_order: int) -> float:
+    """Run the in-memory QALSH ANN estimator and return the A -> B cost per query in microseconds."""
+    command = [
+        str(binary),
+        "--use-fixed-seed",
+        "estimate",
+        "-p",
+        str(norm_order),
+        "-d",
+        str(dataset_dir),
+        "--in-memory",
+        "ann",
+        "qalsh",
+    ]
+    completed = subprocess.run(command, capture_output=True, text=True, check=True)
+
+    # The first report belongs to the A -> B direction, whose query set has a fixed size.
+    match = QUERY_TIME_PATTERN.search(completed.stderr)
+    if match is None:
+        raise RuntimeError(f"No query timing found in output:\n{completed.stderr}")
+    return float(match.group(3))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Measure how the QALSH per-query cost scales with the size of the base set."
+    )
+    parser.add_argument(
+        "--binary",
+        type=Path,
+        default=Path("build/qalsh_chamfer"),
+        help="Path to the qalsh_chamfer executable",
+    )
+    parser.add_argument(
+        "--base-sizes",
+        type=int,
+        nargs="+",
+        default=[10_000, 100_000, 1_000_000],
+        help="Sizes of the base set B to benchmark",
+    )
+    parser.add_argument(
+        "--num-queries", type=int, default=1000, help="Size of the query set A"
+    )
+    parser.add_argument(
+        "--num-dimensions", type=int, default=32, help="Number of dimensions"
+    )
+    parser.add_argument(
+        "--norm-order", type=int, choices=[1, 2], default=2, help="Norm order"
+    )
+    parser.add_argument("--seed", type=int, default=42, help="Random seed")
+    args = parser.parse_args()
+
+    setup_logging(logging.INFO)
+    rng = np.random.default_rng(args.seed)
+
+    results = []
+    with tempfile.TemporaryDirectory() as temp_dir:
+        for num_points_b in args.base_sizes:
+            dataset_dir = Path(temp_dir) / f"n{num_points_b}"
+            generate_dataset(
+                dataset_dir, args.num_queries, num_points_b, args.num_dimensions, rng
+            )
+            cost = measure_query_cost(args.binary, dataset_dir, args.norm_order)
+            logging.info(f"|B| = {num_points_b}: {cost:.3f} us per query")
+            results.append((num_points_b, cost))
+
+    print(f"{'|B|':>12} {'us/query':>12}")
+    for num_points_b, cost in results:
+        print(f"{num_points_b:>12} {cost:>12.3f}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,173 @@
+import argparse
+import logging
+import re
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+import numpy as np
+from utils import create_metadata, save_binary_data, setup_logging
+
+RELATIVE_ERROR_PATTERN = re.compile(r"Relative Error: ([\d.]+)%")
+
+# Estimators that compute the Chamfer distance exactly, with their subcommands.
+EXACT_ESTIMATORS = {
+    "exact": ["exact"],
+    "linear scan": ["ann", "linear_scan"],
+}
+
+
+def brute_force_distance(
+    X: np.ndarray, Y: np.ndarray, norm_order: int, batch_size: int
+) -> np.double:
+    """Sum the distances from every point of X to its nearest neighbor in Y, from the coordinate differences."""
+    total = np.double(0.0)
+    for i in range(0, len(X), batch_size):
+        differences = X[i : i + batch_size, None, :] - Y[None, :, :]
+        if norm_order == 1:
+            distances = np.abs(differences).sum(axis=2)
+        else:
+            distances = np.sqrt((differences * differences).sum(axis=2))
+        total += distances.min(axis=1).sum()
+    return total
+
+
+def generate_dataset(
+    output_dir: Path,
+    num_points_a: int,
+    num_points_b: int,
+    num_dimensions: int,
+    offset: float,
+    rng: np.random.Generator,
+) -> None:
+    """Generate float32 points far from the origin, where ||a||^2 + ||b||^2 - 2 a.b cancels badly in float32."""
+    A = offset + rng.standard_normal((num_points_a, num_dimensions))
+    A = A.astype(np.float32)
+    B = offset + rng.standard_normal((num_points_b, num_dimensions))
+    B = B.astype(np.float32)
+
+    output_dir.mkdir(parents=True, exist_ok=True)
+    save_binary_data(A, output_dir / "A.bin", "float32")
+    save_binary_data(B, output_dir / "B.bin", "float32")
+
+    # The ground truth is computed in float64 from the stored float32 coordinates.
+    A = A.astype(np.float64)
+    B = B.astype(np.float64)
+    ground_truth = {}
+    for norm_order in (1, 2):
+        ground_truth[norm_order] = brute_force_distance(
+            A, B, norm_order, 16
+        ) + brute_force_distance(B, A, norm_order, 16)
+        logging.info(
+            f"Brute force Chamfer distance (L{norm_order}): {ground_truth[norm_order]:.6f}"
+        )
+
+    create_metadata(
+        num_dimensions=num_dimensions,
+        num_points_a=num_points_a,
+        num_points_b=num_points_b,
+        chamfer_distance_l1=ground_truth[1],
+        chamfer_distance_l2=ground_truth[2],
+        filepath=output_dir / "metadata.json",
+        data_type="float32",
+    )
+
+
+def measure_relative_error(
+    binary: Path,
+    dataset_dir: Path,
+    estimator: list[str],
+    norm_order: int,
+    in_memory: bool,
+    num_threads: int,
+) -> float:
+    """Run an estimator and return its relative error to the brute force ground truth, in percent."""
+    command = [
+        str(binary),
+        "estimate",
+        "-p",
+        str(norm_order),
+        "-d",
+        str(dataset_dir),
+        "-t",
+        str(num_threads),
+    ]
+    if in_memory:
+        command.append("--in-memory")
+    command.extend(estimator)
+    completed = subprocess.run(command, capture_output=True, text=True, check=True)
+
+    match = RELATIVE_ERROR_PATTERN.search(completed.stdout)
+    if match is None:
+        raise RuntimeError(f"No relative error found in output:\n{completed.stdout}")
+    return float(match.group(1))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Check the exact and linear scan estimators against a brute force Chamfer distance on offset float32 data."
+    )
+    parser.add_argument(
+        "--binary",
+        type=Path,
+        default=Path("build/qalsh_chamfer"),
+        help="Path to the qalsh_chamfer executable",
+    )
+    parser.add_argument("--num-points-a", type=int, default=2000, help="Size of A")
+    parser.add_argument("--num-points-b", type=int, default=30000, help="Size of B")
+    parser.add_argument(
+        "--num-dimensions", type=int, default=32, help="Number of dimensions"
+    )
+    parser.add_argument(
+        "--offset", type=float, default=1000.0, help="Offset added to every coordinate"
+    )
+    parser.add_argument(
+        "--num-threads", type=int, default=4, help="Number of estimator threads"
+    )
+    parser.add_argument(
+        "--max-relative-error",
+        type=float,
+        default=0.01,
+        help="Largest accepted relative error, in percent (printed with two decimals)",
+    )
+    parser.add_argument("--seed", type=int, default=42, help="Random seed")
+    args = parser.parse_args()
+
+    setup_logging(logging.INFO)
+    rng = np.random.default_rng(args.seed)
+
+    failures = 0
+    with tempfile.TemporaryDirectory() as temp_dir:
+        dataset_dir = Path(temp_dir)
+        generate_dataset(
+            dataset_dir,
+            args.num_points_a,
+            args.num_points_b,
+            args.num_dimensions,
+            args.offset,
+            rng,
+        )
+        for name, estimator in EXACT_ESTIMATORS.items():
+            for norm_order in (1, 2):
+                for in_memory in (True, False):
+                    relative_error = measure_relative_error(
+                        args.binary,
+                        dataset_dir,
+                        estimator,
+                        norm_order,
+                        in_memory,
+                        args.num_threads,
+                    )
+                    passed = relative_error <= args.max_relative_error
+                    failures += not passed
+                    logging.info(
+                        f"{name}, L{norm_order} {'in memory' if in_memory else 'on disk'}: "
+                        f"relative error {relative_error:.2f}% ({'ok' if passed else 'FAILED'})"
+                    )
+
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -206,6 +206,12 @@ def main():
         default=None,
         help="Path to the GIST dataset directory containing gist_base.fvecs file",
     )
+    parser.add_argument(
+        "--data-type",
+        choices=["float32", "float64"],
+        default="float64",
+        help="Precision of the stored coordinates (default: float64)",
+    )
 
     args = parser.parse_args()
 
@@ -276,8 +282,8 @@ def main():
     Dimensions: {A.shape[1]}""")
 
     # Save binary files
-    save_binary_data(A, output_dir / "A.bin")
-    save_binary_data(B, output_dir / "B.bin")
+    save_binary_data(A, output_dir / "A.bin", args.data_type)
+    save_binary_data(B, output_dir / "B.bin", args.data_type)
 
     # Calculate Chamfer distance
     if args.batch_size is None:
@@ -295,6 +301,7 @@ def main():
         chamfer_distance_l1=chamfer_distance_l1,
         chamfer_distance_l2=chamfer_distance_l2,
         filepath=output_dir / "metadata.json",
+        data_type=args.data_type,
     )
 
     total_elapsed_time = time.time() - total_start_time
@@ -116,6 +116,12 @@ def main():
         default="INFO",
         help="Set the logging level (default: INFO)",
     )
+    parser.add_argument(
+        "--data-type",
+        choices=["float32", "float64"],
+        default="float64",
+        help="Precision of the stored coordinates (default: float64)",
+    )
 
     args = parser.parse_args()
 
@@ -149,8 +155,8 @@ def main():
     )
 
     # Save binary files
-    save_binary_data(A, output_dir / "A.bin")
-    save_binary_data(B, output_dir / "B.bin")
+    save_binary_data(A, output_dir / "A.bin", args.data_type)
+    save_binary_data(B, output_dir / "B.bin", args.data_type)
 
     # Calculate the Chamfer distance between two sets
     if args.batch_size is None:
@@ -168,6 +174,7 @@ def main():
         chamfer_distance_l1=chamfer_distance_l1,
         chamfer_distance_l2=chamfer_distance_l2,
         filepath=output_dir / "metadata.json",
+        data_type=args.data_type,
     )
 
     total_elapsed_time = time.time() - total_start_time
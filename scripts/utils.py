@@ -16,12 +16,12 @@ def setup_logging(level: int) -> None:
     )
 
 
-def save_binary_data(data: np.ndarray, filepath: Path) -> None:
-    """Save numpy array as binary file with float32 format."""
+def save_binary_data(data: np.ndarray, filepath: Path, data_type: str = "float64") -> None:
+    """Save numpy array as binary file with the given data type (float32 or float64)."""
     logging.info(f"Saving binary data to {filepath}")
 
-    # Ensure data is double
-    data = data.astype(np.double)
+    # Ensure data has the requested precision
+    data = data.astype(np.dtype(data_type))
 
     # Save as binary file
     with open(filepath, "wb") as f:
@@ -38,9 +38,11 @@ def create_metadata(
     chamfer_distance_l1: np.double,
     chamfer_distance_l2: np.double,
     filepath: Path,
+    data_type: str = "float64",
 ) -> None:
     """Create metadata.json file."""
     metadata = {
+        "data_type": data_type,
         "num_dimensions": num_dimensions,
         "num_points_a": num_points_a,
         "num_points_b": num_points_b,
@@ -54,6 +56,23 @@ def create_metadata(
     logging.info(f"Saved metadata to {filepath}")
 
 
+def save_dataset_without_ground_truth(
+    A: np.ndarray, B: np.ndarray, output_dir: Path
+) -> None:
+    """Save A and B with metadata whose Chamfer distances are zero, for benchmarks that do not check the estimates."""
+    output_dir.mkdir(parents=True, exist_ok=True)
+    save_binary_data(A, output_dir / "A.bin")
+    save_binary_data(B, output_dir / "B.bin")
+    create_metadata(
+        num_dimensions=A.shape[1],
+        num_points_a=A.shape[0],
+        num_points_b=B.shape[0],
+        chamfer_distance_l1=np.double(0.0),
+        chamfer_distance_l2=np.double(0.0),
+        filepath=output_dir / "metadata.json",
+    )
+
+
 def chamfer_distance(
     A: np.ndarray, B: np.ndarray, batch_size: int, p: float
 ) -> np.double:
@@ -3,34 +3,57 @@
 #include <spdlog/spdlog.h>
 
 #include <algorithm>
+#include <cmath>
 #include <cstddef>
+#include <cstring>
 #include <iterator>
 #include <limits>
 #include <memory>
 #include <optional>
-#include <queue>
 #include <random>
 #include <vector>
 
 #include "b_plus_tree.h"
 #include "global.h"
+#include "packed_index.h"
 #include "types.h"
 #include "utils.h"
 
+// ---------------------------------------------
+// AnnSearcher Implementation
+// ---------------------------------------------
+template <typename T>
+std::unique_ptr<typename AnnSearcher<T>::Context> AnnSearcher<T>::CreateContext() const {
+    return std::make_unique<Context>();
+}
+
+template <typename T>
+std::vector<AnnResult> AnnSearcher<T>::SearchBatch(const PointMatrixRef<T>& query_points, Context& context) const {
+    std::vector<AnnResult> results;
+    results.reserve(static_cast<size_t>(query_points.rows()));
+    for (unsigned int i = 0; i < query_points.rows(); i++) {
+        results.emplace_back(Search(Utils::GetPoint(query_points, i), context));
+    }
+    return results;
+}
+
 // ---------------------------------------------
 // InMemoryLinearScanAnnSearcher Definition
 // ---------------------------------------------
-void InMemoryLinearScanAnnSearcher::Init(const PointSetMetadata& base_metadata, double norm_order) {
+template <typename T>
+void InMemoryLinearScanAnnSearcher<T>::Init(const PointSetMetadata& base_metadata, double norm_order) {
     base_points_ =
-        Utils::LoadPointsFromFile(base_metadata.file_path, base_metadata.num_points, base_metadata.num_dimensions);
-    norm_order_ = norm_order;
+        Utils::LoadPointsFromFile<T>(base_metadata.file_path, base_metadata.num_points, base_metadata.num_dimensions);
+    distance_function_ = Distance<T>::Get(norm_order);
 }
 
-AnnResult InMemoryLinearScanAnnSearcher::Search(const Point& query_point) {
+template <typename T>
+AnnResult InMemoryLinearScanAnnSearcher<T>::Search(PointView<T> query_point,
+                                                   [[maybe_unused]] typename AnnSearcher<T>::Context& context) const {
     AnnResult result{.distance = std::numeric_limits<double>::max(), .point_id = 0};
 
-    for (unsigned int i = 0; i < base_points_.size(); i++) {
-        double distance = Utils::LpDistance(base_points_[i], query_point, norm_order_);
+    for (unsigned int i = 0; i < base_points_.rows(); i++) {
+        double distance = distance_function_(Utils::GetPoint(base_points_, i), query_point, result.distance);
         if (distance < result.distance) {
             result.point_id = i;
             result.distance = distance;
@@ -43,46 +66,130 @@ AnnResult InMemoryLinearScanAnnSearcher::Search(const Point& query_point) {
 // ---------------------------------------------
 // DiskLinearScanAnnSearcher Definition
 // ---------------------------------------------
-void DiskLinearScanAnnSearcher::Init(const PointSetMetadata& base_metadata, double norm_order) {
-    if (base_file_.is_open()) {
-        base_file_.close();
-    }
-    base_file_.open(base_metadata.file_path, std::ios::binary);
-    if (!base_file_.is_open()) {
-        spdlog::error("Failed to open base file: {}", base_metadata.file_path.string());
-        return;
-    }
+template <typename T>
+void DiskLinearScanAnnSearcher<T>::Init(const PointSetMetadata& base_metadata, double norm_order) {
+    base_points_.Open(base_metadata, AccessPattern::kSequential);
     num_points_ = base_metadata.num_points;
     num_dimensions_ = base_metadata.num_dimensions;
-    norm_order_ = norm_order;
+    distance_function_ = Distance<T>::Get(norm_order);
 }
 
-AnnResult DiskLinearScanAnnSearcher::Search(const Point& query_point) {
-    AnnResult result{.distance = std::numeric_limits<double>::max(), .point_id = 0};
+template <typename T>
+AnnResult DiskLinearScanAnnSearcher<T>::Search(PointView<T> query_point,
+                                               typename AnnSearcher<T>::Context& context) const {
+    Eigen::Map<const PointMatrix<T>> query(query_point.data(), 1, static_cast<Eigen::Index>(query_point.size()));
+    return SearchBatch(query, context).front();
+}
 
-    for (unsigned int i = 0; i < num_points_; i++) {
-        double distance = Utils::LpDistance(Utils::ReadPoint(base_file_, num_dimensions_, i), query_point, norm_order_);
-        if (distance < result.distance) {
-            result.point_id = i;
-            result.distance = distance;
+template <typename T>
+std::vector<AnnResult> DiskLinearScanAnnSearcher<T>::SearchBatch(const PointMatrixRef<T>& query_points,
+                                                                 typename AnnSearcher<T>::Context& /*context*/) const {
+    std::vector<AnnResult> results(static_cast<size_t>(query_points.rows()),
+                                   AnnResult{.distance = std::numeric_limits<double>::max(), .point_id = 0});
+
+    // Stream the base file once for the whole block of queries, in sequential chunks that are small enough to stay in
+    // cache while every query of the block scans them.
+    auto chunk_size = static_cast<unsigned int>(
+        std::max<size_t>(1, Global::kScanChunkBytes / (static_cast<size_t>(num_dimensions_) * sizeof(T))));
+    for (unsigned int first = 0; first < num_points_; first += chunk_size) {
+        unsigned int size = std::min(chunk_size, num_points_ - first);
+
+        for (unsigned int q = 0; q < query_points.rows(); q++) {
+            PointView<T> query_point = Utils::GetPoint(query_points, q);
+            AnnResult& result = results[q];
+            for (unsigned int i = first; i < first + size; i++) {
+                double distance = distance_function_(base_points_.GetPoint(i), query_point, result.distance);
+                if (distance < result.distance) {
+                    result.point_id = i;
+                    result.distance = distance;
+                }
+            }
         }
     }
 
-    return result;
+    return results;
+}
+
+// ---------------------------------------------
+// CollisionCounter Implementation
+// ---------------------------------------------
+CollisionCounter::CollisionCounter(unsigned int num_points) : entries_(num_points) {}
+
+void CollisionCounter::Reset() {
+    if (++epoch_ == 0) {
+        std::ranges::fill(entries_, Entry{});
+        epoch_ = 1;
+    }
+}
+
+unsigned int CollisionCounter::Increment(unsigned int point_id) {
+    Entry& entry = entries_[point_id];
+    if (entry.epoch != epoch_) {
+        entry = Entry{.epoch = epoch_, .count = 0};
+    }
+    return ++entry.count;
+}
+
+// ---------------------------------------------
+// CandidateSet Implementation
+// ---------------------------------------------
+void CandidateSet::Add(const AnnResult& candidate) {
+    size_++;
+    Resolve(candidate);
+}
+
+void CandidateSet::AddPending(unsigned int point_id) {
+    size_++;
+    pending_.emplace_back(point_id);
+}
+
+void CandidateSet::Resolve(const AnnResult& candidate) {
+    if (num_resolved_++ == 0 || candidate.distance < best_.distance) {
+        best_ = candidate;
+    }
+}
+
+void CandidateSet::Clear() {
+    size_ = 0;
+    num_resolved_ = 0;
+    best_ = AnnResult{.distance = std::numeric_limits<double>::max(), .point_id = 0};
+    pending_.clear();
 }
 
+// ---------------------------------------------
+// ShortList Implementation
+// ---------------------------------------------
+ShortList::ShortList(size_t capacity) : capacity_(capacity) { heap_.reserve(capacity_); }
+
+void ShortList::Add(const AnnResult& candidate) {
+    if (heap_.size() < capacity_) {
+        heap_.emplace_back(candidate);
+        std::ranges::push_heap(heap_, {}, &AnnResult::distance);
+    } else if (capacity_ > 0 && candidate.distance < heap_.front().distance) {
+        std::ranges::pop_heap(heap_, {}, &AnnResult::distance);
+        heap_.back() = candidate;
+        std::ranges::push_heap(heap_, {}, &AnnResult::distance);
+    }
+}
+
+void ShortList::Clear() { heap_.clear(); }
+
 // ---------------------------------------------
 // InMemoryQalshAnnSearcher Implementation
 // ---------------------------------------------
-InMemoryQalshAnnSearcher::InMemoryQalshAnnSearcher(double approximation_ratio) : gen_(Utils::CreateSeededGenerator()) {
+template <typename T>
+InMemoryQalshAnnSearcher<T>::InMemoryQalshAnnSearcher(double approximation_ratio)
+    : gen_(Utils::CreateSeededGenerator()) {
     qalsh_config_.approximation_ratio = approximation_ratio;
 }
 
-void InMemoryQalshAnnSearcher::Init(const PointSetMetadata& base_metadata, double norm_order) {
+template <typename T>
+void InMemoryQalshAnnSearcher<T>::Init(const PointSetMetadata& base_metadata, double norm_order) {
     // Load the base points from the file.
     base_points_ =
-        Utils::LoadPointsFromFile(base_metadata.file_path, base_metadata.num_points, base_metadata.num_dimensions);
+        Utils::LoadPointsFromFile<T>(base_metadata.file_path, base_metadata.num_points, base_metadata.num_dimensions);
     norm_order_ = norm_order;
+    distance_function_ = Distance<T>::Get(norm_order_);
 
     // Regularize the QalshConfig parameters based on the number of points.
     Utils::RegularizeQalshConfig(qalsh_config_, base_metadata.num_points, norm_order_);
@@ -99,10 +206,8 @@ void InMemoryQalshAnnSearcher::Init(const PointSetMetadata& base_metadata, doubl
         qalsh_config_.num_hash_tables, qalsh_config_.collision_threshold);
 
     // Generate dot vectors.
-    dot_vectors_.clear();
-    dot_vectors_.resize(qalsh_config_.num_hash_tables);
     std::function<double()> generator;
-    auto num_dimensions = static_cast<unsigned int>(base_points_[0].size());
+    auto num_dimensions = static_cast<unsigned int>(base_points_.cols());
 
     if (std::abs(norm_order_ - 1.0) < Global::kEpsilon) {
         std::cauchy_distribution<double> dist(0.0, 1.0);
@@ -116,47 +221,80 @@ void InMemoryQalshAnnSearcher::Init(const PointSetMetadata& base_metadata, doubl
         spdlog::error("Unsupported norm order: {}", norm_order_);
     }
 
-    for (unsigned int i = 0; i < qalsh_config_.num_hash_tables; i++) {
-        dot_vectors_[i].reserve(num_dimensions);
-        std::ranges::generate_n(std::back_inserter(dot_vectors_[i]), num_dimensions, [&]() { return generator(); });
-    }
+    dot_vectors_.resize(qalsh_config_.num_hash_tables, num_dimensions);
+    std::ranges::generate_n(dot_vectors_.data(), dot_vectors_.size(), [&]() { return static_cast<T>(generator()); });
 
-    // Initialize QALSH hash tables.
+    // Initialize QALSH hash tables, projecting all base points with a single matrix-matrix product.
+    Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> projections = base_points_ * dot_vectors_.transpose();
     hash_tables_.clear();
     hash_tables_.resize(qalsh_config_.num_hash_tables);
     for (unsigned int i = 0; i < qalsh_config_.num_hash_tables; i++) {
         hash_tables_[i].reserve(base_metadata.num_points);
         for (unsigned int j = 0; j < base_metadata.num_points; j++) {
-            hash_tables_[i].emplace_back(DotProductPointIdPair{
-                .dot_product = Utils::DotProduct(base_points_[j], dot_vectors_[i]), .point_id = j});
+            hash_tables_[i].emplace_back(DotProductPointIdPair<T>{.dot_product = projections(j, i), .point_id = j});
         }
-        std::ranges::sort(hash_tables_[i], {}, &DotProductPointIdPair::dot_product);
+        std::ranges::sort(hash_tables_[i], {}, &DotProductPointIdPair<T>::dot_product);
+    }
+}
+
+template <typename T>
+std::unique_ptr<typename AnnSearcher<T>::Context> InMemoryQalshAnnSearcher<T>::CreateContext() const {
+    auto context = std::make_unique<Context>();
+    context->collision_counter = CollisionCounter(static_cast<unsigned int>(base_points_.rows()));
+    context->lefts.reserve(qalsh_config_.num_hash_tables);
+    context->rights.reserve(qalsh_config_.num_hash_tables);
+    context->finish.reserve(qalsh_config_.num_hash_tables);
+    return context;
+}
+
+template <typename T>
+AnnResult InMemoryQalshAnnSearcher<T>::Search(PointView<T> query_point,
+                                              typename AnnSearcher<T>::Context& context) const {
+    Eigen::Map<const Eigen::Vector<T, Eigen::Dynamic>> query(query_point.data(),
+                                                             static_cast<Eigen::Index>(query_point.size()));
+    Eigen::Vector<T, Eigen::Dynamic> keys = dot_vectors_ * query;
+    return SearchWithKeys(query_point, {keys.data(), static_cast<size_t>(keys.size())}, static_cast<Context&>(context));
+}
+
+template <typename T>
+std::vector<AnnResult> InMemoryQalshAnnSearcher<T>::SearchBatch(const PointMatrixRef<T>& query_points,
+                                                                typename AnnSearcher<T>::Context& context) const {
+    // Project the whole block against every dot vector with a single matrix-matrix product.
+    PointMatrix<T> keys = query_points * dot_vectors_.transpose();
+
+    std::vector<AnnResult> results;
+    results.reserve(static_cast<size_t>(query_points.rows()));
+    for (unsigned int i = 0; i < query_points.rows(); i++) {
+        results.emplace_back(SearchWithKeys(Utils::GetPoint(query_points, i), Utils::GetPoint(keys, i),
+                                            static_cast<Context&>(context)));
     }
+    return results;
 }
 
 // NOLINTBEGIN(readability-function-cognitive-complexity)
-AnnResult InMemoryQalshAnnSearcher::Search(const Point& query_point) {
-    std::vector<unsigned int> collision_count(base_points_.size(), 0);
-    std::vector<bool> visited(base_points_.size(), false);
-    std::priority_queue<AnnResult, std::vector<AnnResult>, CompareAnnResult> candidates;
+template <typename T>
+AnnResult InMemoryQalshAnnSearcher<T>::SearchWithKeys(PointView<T> query_point, std::span<const T> keys,
+                                                      Context& context) const {
+    // Reuse the context's workspace; resetting it costs O(num_hash_tables), not O(num_points).
+    CollisionCounter& collision_counter = context.collision_counter;
+    CandidateSet& candidates = context.candidates;
+    std::vector<std::optional<unsigned int>>& lefts = context.lefts;
+    std::vector<std::optional<unsigned int>>& rights = context.rights;
+    std::vector<bool>& finish = context.finish;
+    collision_counter.Reset();
+    candidates.Clear();
+    lefts.clear();
+    rights.clear();
 
     unsigned int num_hash_tables = qalsh_config_.num_hash_tables;
     unsigned int collision_threshold = qalsh_config_.collision_threshold;
     double bucket_width = qalsh_config_.bucket_width;
     double approximation_ratio = qalsh_config_.approximation_ratio;
 
-    std::vector<double> keys;
-    keys.reserve(num_hash_tables);
-    std::vector<std::optional<unsigned int>> lefts;
-    lefts.reserve(num_hash_tables);
-    std::vector<std::optional<unsigned int>> rights;
-    rights.reserve(num_hash_tables);
-
     // Initialize the keys, lefts and rights.
     for (unsigned int i = 0; i < num_hash_tables; i++) {
-        double table_key = Utils::DotProduct(query_point, dot_vectors_[i]);
-        keys.emplace_back(table_key);
-        auto it = std::ranges::lower_bound(hash_tables_[i], table_key, {}, &DotProductPointIdPair::dot_product);
+        T table_key = keys[i];
+        auto it = std::ranges::lower_bound(hash_tables_[i], table_key, {}, &DotProductPointIdPair<T>::dot_product);
         auto index = static_cast<size_t>(std::distance(hash_tables_[i].begin(), it));
 
         lefts.emplace_back(index == 0 ? std::nullopt : std::make_optional(index - 1));
@@ -169,13 +307,13 @@ AnnResult InMemoryQalshAnnSearcher::Search(const Point& query_point) {
 
     while (true) {
         unsigned int num_finished = 0;
-        std::vector<bool> finish(num_hash_tables, false);
+        finish.assign(num_hash_tables, false);
         while (num_finished < num_hash_tables) {
             for (unsigned int i = 0; i < num_hash_tables; i++) {
                 if (finish[i]) {
                     continue;
                 }
-                double table_key = keys[i];
+                T table_key = keys[i];
 
                 // Scan the left side of hash table.
                 bool left_finished = !lefts[i].has_value();
@@ -184,16 +322,17 @@ AnnResult InMemoryQalshAnnSearcher::Search(const Point& query_point) {
                         left_finished = true;
                         break;
                     }
-                    auto& [dot_product, point_id] = hash_tables_[i][lefts[i].value()];
+                    const auto& [dot_product, point_id] = hash_tables_[i][lefts[i].value()];
                     if (table_key - dot_product > width) {
                         left_finished = true;
                         break;
                     }
-                    if (!visited[point_id] && ++collision_count[point_id] >= collision_threshold) {
-                        visited[point_id] = true;
-                        candidates.emplace(
-                            AnnResult{.distance = Utils::LpDistance(base_points_[point_id], query_point, norm_order_),
-                                      .point_id = point_id});
+                    // A point becomes a candidate exactly once, when its count reaches the threshold.
+                    if (collision_counter.Increment(point_id) == collision_threshold) {
+                        candidates.Add(AnnResult{
+                            .distance = distance_function_(Utils::GetPoint(base_points_, point_id), query_point,
+                                                           candidates.best().distance),
+                            .point_id = point_id});
                         if (candidates.size() >= Global::kNumCandidates) {
                             break;
                         }
@@ -217,16 +356,16 @@ AnnResult InMemoryQalshAnnSearcher::Search(const Point& query_point) {
                         right_finish = true;
                         break;
                     }
-                    auto& [dot_product, point_id] = hash_tables_[i][rights[i].value()];
+                    const auto& [dot_product, point_id] = hash_tables_[i][rights[i].value()];
                     if (dot_product - table_key > width) {
                         right_finish = true;
                         break;
                     }
-                    if (!visited[point_id] && ++collision_count[point_id] >= collision_threshold) {
-                        visited[point_id] = true;
-                        candidates.emplace(
-                            AnnResult{.distance = Utils::LpDistance(base_points_[point_id], query_point, norm_order_),
-                                      .point_id = point_id});
+                    if (collision_counter.Increment(point_id) == collision_threshold) {
+                        candidates.Add(AnnResult{
+                            .distance = distance_function_(Utils::GetPoint(base_points_, point_id), query_point,
+                                                           candidates.best().distance),
+                            .point_id = point_id});
                         if (candidates.size() >= Global::kNumCandidates) {
                             break;
                         }
@@ -254,7 +393,7 @@ AnnResult InMemoryQalshAnnSearcher::Search(const Point& query_point) {
                 break;
             }
         }
-        if (!candidates.empty() && (candidates.top().distance <= approximation_ratio * radius ||
+        if (!candidates.empty() && (candidates.best().distance <= approximation_ratio * radius ||
                                     candidates.size() >= Global::kNumCandidates)) {
             break;
         }
@@ -264,32 +403,39 @@ AnnResult InMemoryQalshAnnSearcher::Search(const Point& query_point) {
     }
 
     return candidates.empty() ? AnnResult{.distance = std::numeric_limits<double>::max(), .point_id = 0}
-                              : candidates.top();
+                              : candidates.best();
 }
 // NOLINTEND(readability-function-cognitive-complexity)
 
 // ---------------------------------------------
 // DiskQalshAnnSearcher Implementation
 // ---------------------------------------------
-void DiskQalshAnnSearcher::Init(const PointSetMetadata& base_metadata, double norm_order) {
-    // Open the base file.
-    if (base_file_.is_open()) {
-        base_file_.close();
-    }
-    base_file_.open(base_metadata.file_path, std::ios::binary);
-    if (!base_file_.is_open()) {
-        spdlog::error("Failed to open base file: {}", base_metadata.file_path.string());
-        return;
-    }
+template <typename T>
+DiskQalshAnnSearcher<T>::DiskQalshAnnSearcher(unsigned int num_pinned_levels, bool direct_io)
+    : num_pinned_levels_(num_pinned_levels), direct_io_(direct_io) {}
+
+template <typename T>
+void DiskQalshAnnSearcher<T>::Init(const PointSetMetadata& base_metadata, double norm_order) {
     num_points_ = base_metadata.num_points;
     num_dimensions_ = base_metadata.num_dimensions;
     norm_order_ = norm_order;
+    distance_function_ = Distance<T>::Get(norm_order_);
 
     // Load QALSH configuration.
     std::string stem = base_metadata.file_path.stem();
     std::filesystem::path index_directory =
         base_metadata.file_path.parent_path() / "index" / std::format("l{}", norm_order_) / stem;
-    qalsh_config_ = Utils::LoadQalshConfig(index_directory / "config.json");
+    bool packed = PackedIndex::Exists(index_directory);
+    PackedIndex::Directory directory;
+    if (packed) {
+        directory = PackedIndex::ReadHeader(index_directory / PackedIndex::kFileName);
+        qalsh_config_ = directory.config;
+    } else {
+        qalsh_config_ = Utils::LoadQalshConfig(index_directory / "config.json");
+    }
+    if (qalsh_config_.data_type != base_metadata.data_type) {
+        spdlog::error("The index in {} was built for another data type. Please rebuild it.", index_directory.string());
+    }
 
     // Print the QalshConfig parameters.
     spdlog::info(
@@ -299,96 +445,227 @@ void DiskQalshAnnSearcher::Init(const PointSetMetadata& base_metadata, double no
         "\tError Probability: {}\n"
         "\tNumber of Hash Tables: {}\n"
         "\tCollision Threshold: {}\n"
-        "\tPage Size: {}",
+        "\tPage Size: {}\n"
+        "\tQuantized: {}\n"
+        "\tCompressed Leaves: {}\n"
+        "\tReordered: {}",
         qalsh_config_.approximation_ratio, qalsh_config_.bucket_width, qalsh_config_.error_probability,
-        qalsh_config_.num_hash_tables, qalsh_config_.collision_threshold, qalsh_config_.page_size);
+        qalsh_config_.num_hash_tables, qalsh_config_.collision_threshold, qalsh_config_.page_size,
+        qalsh_config_.quantized, qalsh_config_.compressed_leaves, qalsh_config_.reordered);
+    point_id_bits_ = qalsh_config_.compressed_leaves ? LeafNode<T>::GetPointIdBits(num_points_) : 0;
 
-    // Initialize the buffer.
-    buffer_.clear();
-    buffer_.resize(qalsh_config_.page_size);
+    // The B+ tree of hash table i is read through region i of the buffer pool. A packed index serves all of them from
+    // a single descriptor.
+    buffer_pool_ = std::make_unique<BufferPool>(qalsh_config_.page_size,
+                                                Global::kBufferPoolBytes / qalsh_config_.page_size);
+    std::filesystem::path tree_path =
+        packed ? index_directory / PackedIndex::kFileName : index_directory / "b_plus_trees" / "0.bin";
+    CheckDirectIo(tree_path);
+    if (packed) {
+        unsigned int file_id = buffer_pool_->AddFile(tree_path, direct_io_);
+        for (uint64_t tree_offset : directory.tree_offsets) {
+            buffer_pool_->AddRegion(file_id, tree_offset);
+        }
+    } else {
+        std::filesystem::path b_plus_tree_directory = index_directory / "b_plus_trees";
+        for (unsigned int i = 0; i < qalsh_config_.num_hash_tables; i++) {
+            buffer_pool_->AddRegion(
+                buffer_pool_->AddFile(b_plus_tree_directory / std::format("{}.bin", i), direct_io_), 0);
+        }
+    }
 
-    // Open the hash tables.
-    hash_tables_.clear();
-    hash_tables_.reserve(qalsh_config_.num_hash_tables);
-    std::filesystem::path b_plus_tree_directory = index_directory / "b_plus_trees";
-    for (unsigned int i = 0; i < qalsh_config_.num_hash_tables; i++) {
-        std::ifstream ifs(b_plus_tree_directory / std::format("{}.bin", i), std::ios::binary);
-        if (!ifs.is_open()) {
-            spdlog::error("Failed to open hash table file: {}",
-                          (b_plus_tree_directory / std::format("{}.bin", i)).string());
-            return;
+    // Candidates are verified in hash order, which is random with respect to the base file. A reordered index
+    // verifies them on its own copy of the points instead, where the candidates of a query are mostly neighbours.
+    // With direct I/O, the points are read through the buffer pool as well, in the region that follows the trees.
+    PointSetMetadata points_metadata = base_metadata;
+    if (qalsh_config_.reordered) {
+        points_metadata.file_path = index_directory / "points.bin";
+        std::ifstream point_ids_file(index_directory / "point_ids.bin", std::ios::binary);
+        if (!point_ids_file.is_open()) {
+            spdlog::error("Failed to open point ids file: {}", (index_directory / "point_ids.bin").string());
         }
-        hash_tables_.emplace_back(std::move(ifs));
+        point_ids_.resize(num_points_);
+        point_ids_file.read(reinterpret_cast<char*>(point_ids_.data()),
+                            static_cast<std::streamsize>(point_ids_.size() * sizeof(unsigned int)));
+    }
+    if (direct_io_) {
+        CheckDirectIo(points_metadata.file_path);
+        base_points_region_ =
+            buffer_pool_->AddRegion(buffer_pool_->AddFile(points_metadata.file_path, /*direct_io=*/true), 0);
+    } else {
+        base_points_.Open(points_metadata, AccessPattern::kRandom);
+    }
+
+    // Pin the headers and the top internal levels, so that descending a tree only reads its leaf.
+    PageBuffer buffer(qalsh_config_.page_size);
+    pinned_trees_.assign(qalsh_config_.num_hash_tables, PinnedTree{});
+    size_t num_pinned_bytes = 0;
+    for (unsigned int i = 0; i < qalsh_config_.num_hash_tables; i++) {
+        PinTree(i, buffer);
+        const PinnedTree& tree = pinned_trees_[i];
+        num_pinned_bytes += tree.nodes.size() * sizeof(typename PinnedTree::Node) + tree.keys.size() * sizeof(T) +
+                            tree.children.size() * sizeof(unsigned int);
     }
+    spdlog::info("Pinned the top internal levels of the B+ trees in {:.3f} MiB",
+                 static_cast<double>(num_pinned_bytes) / (1 << 20));  // NOLINT(readability-magic-numbers)
 
     // Load the dot vectors.
-    std::ifstream dot_vector_file(index_directory / "dot_vectors.bin", std::ios::binary);
+    std::filesystem::path dot_vector_path =
+        packed ? index_directory / PackedIndex::kFileName : index_directory / "dot_vectors.bin";
+    std::ifstream dot_vector_file(dot_vector_path, std::ios::binary);
     if (!dot_vector_file.is_open()) {
-        spdlog::error("Failed to open dot vectors file: {}", (index_directory / "dot_vectors.bin").string());
+        spdlog::error("Failed to open dot vectors file: {}", dot_vector_path.string());
         return;
     }
-    dot_vectors_.clear();
-    dot_vectors_.resize(qalsh_config_.num_hash_tables);
-    for (unsigned int i = 0; i < qalsh_config_.num_hash_tables; i++) {
-        dot_vectors_[i].resize(num_dimensions_);
-        dot_vector_file.read(reinterpret_cast<char*>(dot_vectors_[i].data()),
-                             static_cast<std::streamsize>(num_dimensions_ * sizeof(Coordinate)));
+    dot_vector_file.seekg(static_cast<std::streamoff>(directory.dot_vectors_offset), std::ios::beg);
+    dot_vectors_.resize(qalsh_config_.num_hash_tables, num_dimensions_);
+    dot_vector_file.read(reinterpret_cast<char*>(dot_vectors_.data()),
+                         static_cast<std::streamsize>(dot_vectors_.size() * sizeof(T)));
+
+    // Load the quantizer and the codes of the base points.
+    if (qalsh_config_.quantized) {
+        quantizer_.Load(index_directory / "quantizer.bin", num_dimensions_);
+        quantized_distance_ =
+            std::abs(norm_order_ - 1.0) < Global::kEpsilon ? &ScalarQuantizer::L1 : &ScalarQuantizer::L2;
+
+        std::ifstream codes_file(index_directory / "codes.bin", std::ios::binary);
+        if (!codes_file.is_open()) {
+            spdlog::error("Failed to open codes file: {}", (index_directory / "codes.bin").string());
+        }
+        codes_.resize(static_cast<size_t>(num_points_) * num_dimensions_);
+        codes_file.read(reinterpret_cast<char*>(codes_.data()), static_cast<std::streamsize>(codes_.size()));
+    }
+}
+
+template <typename T>
+std::unique_ptr<typename AnnSearcher<T>::Context> DiskQalshAnnSearcher<T>::CreateContext() const {
+    auto context = std::make_unique<Context>();
+
+    // Initialize the page frames and the search workspace.
+    context->frames.resize(2 * static_cast<size_t>(qalsh_config_.num_hash_tables) * qalsh_config_.page_size);
+    if (direct_io_) {
+        // A point spans at most this many pages.
+        size_t num_point_pages = (static_cast<size_t>(num_dimensions_) * sizeof(T) - 1) / qalsh_config_.page_size + 2;
+        context->point_pages.resize(num_point_pages * qalsh_config_.page_size);
+        context->batch_pages.resize(Global::kNumCandidates * num_point_pages * qalsh_config_.page_size);
+    }
+    context->collision_counter = CollisionCounter(num_points_);
+    context->short_list = ShortList(Global::kNumRerankCandidates);
+    context->lefts.reserve(qalsh_config_.num_hash_tables);
+    context->rights.reserve(qalsh_config_.num_hash_tables);
+    context->finish.reserve(qalsh_config_.num_hash_tables);
+    context->io_ring.Open(2 * qalsh_config_.num_hash_tables);
+    context->page_requests.reserve(2 * static_cast<size_t>(qalsh_config_.num_hash_tables));
+    context->num_leaves_scanned.assign(2 * static_cast<size_t>(qalsh_config_.num_hash_tables), 0);
+    context->mean_leaves_scanned.assign(2 * static_cast<size_t>(qalsh_config_.num_hash_tables), 0.0);
+    context->readahead_frontiers.assign(2 * static_cast<size_t>(qalsh_config_.num_hash_tables), 0);
+
+    return context;
+}
+
+template <typename T>
+AnnResult DiskQalshAnnSearcher<T>::Search(PointView<T> query_point, typename AnnSearcher<T>::Context& context) const {
+    Eigen::Map<const Eigen::Vector<T, Eigen::Dynamic>> query(query_point.data(),
+                                                             static_cast<Eigen::Index>(query_point.size()));
+    Eigen::Vector<T, Eigen::Dynamic> keys = dot_vectors_ * query;
+    return SearchWithKeys(query_point, {keys.data(), static_cast<size_t>(keys.size())}, static_cast<Context&>(context));
+}
+
+template <typename T>
+std::vector<AnnResult> DiskQalshAnnSearcher<T>::SearchBatch(const PointMatrixRef<T>& query_points,
+                                                            typename AnnSearcher<T>::Context& context) const {
+    // Project the whole block against every dot vector with a single matrix-matrix product.
+    PointMatrix<T> keys = query_points * dot_vectors_.transpose();
+
+    std::vector<AnnResult> results;
+    results.reserve(static_cast<size_t>(query_points.rows()));
+    for (unsigned int i = 0; i < query_points.rows(); i++) {
+        results.emplace_back(SearchWithKeys(Utils::GetPoint(query_points, i), Utils::GetPoint(keys, i),
+                                            static_cast<Context&>(context)));
     }
+    return results;
 }
 
 // NOLINTBEGIN(readability-function-cognitive-complexity)
-AnnResult DiskQalshAnnSearcher::Search(const Point& query_point) {
-    std::vector<unsigned int> collision_count(num_points_, 0);
-    std::vector<bool> visited(num_points_, false);
-    std::priority_queue<AnnResult, std::vector<AnnResult>, CompareAnnResult> candidates;
+template <typename T>
+AnnResult DiskQalshAnnSearcher<T>::SearchWithKeys(PointView<T> query_point, std::span<const T> keys,
+                                                  Context& context) const {
+    // Reuse the context's workspace; resetting it costs O(num_hash_tables), not O(num_points).
+    CollisionCounter& collision_counter = context.collision_counter;
+    CandidateSet& candidates = context.candidates;
+    std::vector<std::optional<SearchRecord>>& lefts = context.lefts;
+    std::vector<std::optional<SearchRecord>>& rights = context.rights;
+    std::vector<bool>& finish = context.finish;
+    collision_counter.Reset();
+    candidates.Clear();
+    lefts.clear();
+    rights.clear();
+    if (qalsh_config_.quantized) {
+        quantizer_.ShiftQuery(query_point, context.shifted_query);
+        context.short_list.Clear();
+    }
 
     unsigned int num_hash_tables = qalsh_config_.num_hash_tables;
     unsigned int collision_threshold = qalsh_config_.collision_threshold;
     double bucket_width = qalsh_config_.bucket_width;
     double approximation_ratio = qalsh_config_.approximation_ratio;
 
-    std::vector<double> keys;
-    keys.reserve(num_hash_tables);
-    std::vector<std::optional<SearchRecord>> lefts;
-    lefts.reserve(num_hash_tables);
-    std::vector<std::optional<SearchRecord>> rights;
-    rights.reserve(num_hash_tables);
-
-    // Initialize the keys, lefts and rights.
+    // Locate the leaf node that may contain the key of every hash table, and fetch all of them in one batch, each in
+    // the frame of its right scan.
+    std::vector<BufferPool::PageRequest>& page_requests = context.page_requests;
+    page_requests.clear();
     for (unsigned int i = 0; i < num_hash_tables; i++) {
-        double table_key = Utils::DotProduct(query_point, dot_vectors_[i]);
-        keys.emplace_back(table_key);
+        char* right_frame = GetFrame(context, i) + qalsh_config_.page_size;
+        page_requests.emplace_back(
+            BufferPool::PageRequest{.region_id = i,
+                                    .page_num = FindLeafMayContainKey(i, keys[i], right_frame),
+                                    .page = std::span<char>(right_frame, qalsh_config_.page_size)});
+    }
+    buffer_pool_->ReadPages(page_requests, context.io_ring);
 
-        // Locate the leaf node that may contain the key.
-        std::shared_ptr<LeafNode> leaf_node = LocateLeafMayContainKey(hash_tables_[i], table_key);
-        auto it = std::ranges::lower_bound(leaf_node->keys_, table_key);
-        auto index = static_cast<size_t>(std::distance(leaf_node->keys_.begin(), it));
+    // Initialize the lefts and rights. A scan that starts in a sibling of the located leaf waits for a second batch.
+    page_requests.clear();
+    for (unsigned int i = 0; i < num_hash_tables; i++) {
+        char* left_frame = GetFrame(context, i);
+        char* right_frame = left_frame + qalsh_config_.page_size;
+        LeafNodeView<T> leaf_node(right_frame, point_id_bits_);
+        unsigned int index = leaf_node.LowerBound(keys[i]);
 
-        // Determine the left search location
+        // Determine the left search location. The two scans move independently, so when both start in the located
+        // leaf, the left one gets its own copy of the page.
+        lefts.emplace_back(std::nullopt);
         if (index == 0) {
-            if (leaf_node->prev_leaf_page_num_ != 0) {
-                std::shared_ptr<LeafNode> prev_leaf_node =
-                    LocateLeafByPageNum(hash_tables_[i], leaf_node->prev_leaf_page_num_);
-                lefts.emplace_back(
-                    SearchRecord{.leaf_node = prev_leaf_node, .index = prev_leaf_node->num_entries_ - 1});
-            } else {
-                lefts.emplace_back(std::nullopt);
+            if (leaf_node.prev_leaf_page_num() != 0) {
+                page_requests.emplace_back(
+                    BufferPool::PageRequest{.region_id = i,
+                                            .page_num = leaf_node.prev_leaf_page_num(),
+                                            .page = std::span<char>(left_frame, qalsh_config_.page_size)});
             }
         } else {
-            lefts.emplace_back(SearchRecord{.leaf_node = leaf_node, .index = static_cast<unsigned int>(index - 1)});
+            std::memcpy(left_frame, right_frame, qalsh_config_.page_size);
+            lefts[i] = SearchRecord{.leaf_node = LeafNodeView<T>(left_frame, point_id_bits_), .index = index - 1};
         }
 
         // Determine the right search location
-        if (index == leaf_node->keys_.size()) {
-            if (leaf_node->next_leaf_page_num_ != 0) {
-                std::shared_ptr<LeafNode> next_leaf_node =
-                    LocateLeafByPageNum(hash_tables_[i], leaf_node->next_leaf_page_num_);
-                rights.emplace_back(SearchRecord{.leaf_node = next_leaf_node, .index = 0});
-            } else {
-                rights.emplace_back(std::nullopt);
+        rights.emplace_back(std::nullopt);
+        if (index == leaf_node.num_entries()) {
+            if (leaf_node.next_leaf_page_num() != 0) {
+                page_requests.emplace_back(
+                    BufferPool::PageRequest{.region_id = i,
+                                            .page_num = leaf_node.next_leaf_page_num(),
+                                            .page = std::span<char>(right_frame, qalsh_config_.page_size)});
             }
         } else {
-            rights.emplace_back(SearchRecord{.leaf_node = leaf_node, .index = static_cast<unsigned int>(index)});
+            rights[i] = SearchRecord{.leaf_node = leaf_node, .index = index};
+        }
+    }
+    buffer_pool_->ReadPages(page_requests, context.io_ring);
+    for (const BufferPool::PageRequest& request : page_requests) {
+        LeafNodeView<T> leaf_node(request.page.data(), point_id_bits_);
+        if (request.page.data() == GetFrame(context, request.region_id)) {
+            lefts[request.region_id] = SearchRecord{.leaf_node = leaf_node, .index = leaf_node.num_entries() - 1};
+        } else {
+            rights[request.region_id] = SearchRecord{.leaf_node = leaf_node, .index = 0};
         }
     }
 
@@ -398,13 +675,15 @@ AnnResult DiskQalshAnnSearcher::Search(const Point& query_point) {
 
     while (true) {
         unsigned int num_finished = 0;
-        std::vector<bool> finish(num_hash_tables, false);
+        finish.assign(num_hash_tables, false);
         while (num_finished < num_hash_tables) {
             for (unsigned int i = 0; i < num_hash_tables; i++) {
                 if (finish[i]) {
                     continue;
                 }
-                double table_key = keys[i];
+                T table_key = keys[i];
+                char* left_frame = GetFrame(context, i);
+                char* right_frame = left_frame + qalsh_config_.page_size;
 
                 // Scan the left side of hash table.
                 bool left_finished = !lefts[i].has_value();
@@ -419,19 +698,16 @@ AnnResult DiskQalshAnnSearcher::Search(const Point& query_point) {
                         break;
                     }
 
-                    double dot_product = leaf_node->keys_[index];
-                    unsigned int point_id = leaf_node->values_[index];
+                    T dot_product = leaf_node.key(index);
+                    unsigned int point_id = leaf_node.value(index);
 
                     if (table_key - dot_product > width) {
                         left_finished = true;
                         break;
                     }
-                    if (!visited[point_id] && ++collision_count[point_id] >= collision_threshold) {
-                        visited[point_id] = true;
-                        candidates.emplace(AnnResult{
-                            .distance = Utils::LpDistance(Utils::ReadPoint(base_file_, num_dimensions_, point_id),
-                                                          query_point, norm_order_),
-                            .point_id = point_id});
+                    // A point becomes a candidate exactly once, when its count reaches the threshold.
+                    if (collision_counter.Increment(point_id) == collision_threshold) {
+                        candidates.AddPending(point_id);
                         if (candidates.size() >= Global::kNumCandidates) {
                             break;
                         }
@@ -439,13 +715,14 @@ AnnResult DiskQalshAnnSearcher::Search(const Point& query_point) {
                     if (index > 0) {
                         index--;
                     } else {
-                        if (leaf_node->prev_leaf_page_num_ == 0) {
+                        if (leaf_node.prev_leaf_page_num() == 0) {
                             lefts[i] = std::nullopt;
                             left_finished = true;
                             break;
                         }
-                        leaf_node = LocateLeafByPageNum(hash_tables_[i], leaf_node->prev_leaf_page_num_);
-                        index = leaf_node->num_entries_ - 1;
+                        ReadAhead(context, i, false, leaf_node.prev_leaf_page_num());
+                        leaf_node = LocateLeafByPageNum(i, leaf_node.prev_leaf_page_num(), left_frame);
+                        index = leaf_node.num_entries() - 1;
                     }
                 }
                 if (candidates.size() >= Global::kNumCandidates) {
@@ -465,32 +742,29 @@ AnnResult DiskQalshAnnSearcher::Search(const Point& query_point) {
                         break;
                     }
 
-                    double dot_product = leaf_node->keys_[index];
-                    unsigned int point_id = leaf_node->values_[index];
+                    T dot_product = leaf_node.key(index);
+                    unsigned int point_id = leaf_node.value(index);
 
                     if (dot_product - table_key > width) {
                         right_finish = true;
                         break;
                     }
-                    if (!visited[point_id] && ++collision_count[point_id] >= collision_threshold) {
-                        visited[point_id] = true;
-                        candidates.emplace(AnnResult{
-                            .distance = Utils::LpDistance(Utils::ReadPoint(base_file_, num_dimensions_, point_id),
-                                                          query_point, norm_order_),
-                            .point_id = point_id});
+                    if (collision_counter.Increment(point_id) == collision_threshold) {
+                        candidates.AddPending(point_id);
                         if (candidates.size() >= Global::kNumCandidates) {
                             break;
                         }
                     }
-                    if (index < leaf_node->num_entries_ - 1) {
+                    if (index < leaf_node.num_entries() - 1) {
                         index++;
                     } else {
-                        if (leaf_node->next_leaf_page_num_ == 0) {
+                        if (leaf_node.next_leaf_page_num() == 0) {
                             rights[i] = std::nullopt;
                             right_finish = true;
                             break;
                         }
-                        leaf_node = LocateLeafByPageNum(hash_tables_[i], leaf_node->next_leaf_page_num_);
+                        ReadAhead(context, i, true, leaf_node.next_leaf_page_num());
+                        leaf_node = LocateLeafByPageNum(i, leaf_node.next_leaf_page_num(), right_frame);
                         index = 0;
                     }
                 }
@@ -509,7 +783,8 @@ AnnResult DiskQalshAnnSearcher::Search(const Point& query_point) {
                 break;
             }
         }
-        if (!candidates.empty() && (candidates.top().distance <= approximation_ratio * radius ||
+        VerifyPendingCandidates(context, query_point);
+        if (!candidates.empty() && (candidates.best().distance <= approximation_ratio * radius ||
                                     candidates.size() >= Global::kNumCandidates)) {
             break;
         }
@@ -518,39 +793,306 @@ AnnResult DiskQalshAnnSearcher::Search(const Point& query_point) {
         width = bucket_width * radius / 2.0;  // NOLINT(readability-magic-numbers)
     }
 
-    return candidates.empty() ? AnnResult{.distance = std::numeric_limits<double>::max(), .point_id = 0}
-                              : candidates.top();
+    UpdateReadAhead(context);
+
+    if (candidates.empty()) {
+        return AnnResult{.distance = std::numeric_limits<double>::max(), .point_id = 0};
+    }
+    AnnResult result = qalsh_config_.quantized ? Rerank(context, query_point) : candidates.best();
+    if (qalsh_config_.reordered) {
+        result.point_id = point_ids_[result.point_id];
+    }
+    return result;
 }
 // NOLINTEND(readability-function-cognitive-complexity)
 
-std::shared_ptr<LeafNode> DiskQalshAnnSearcher::LocateLeafMayContainKey(std::ifstream& ifs, double key) {
-    ReadPage(ifs, 0);
-    size_t offset = 0;
-    auto root_page_num = Utils::ReadFromBuffer<unsigned int>(buffer_, offset);
-    auto level = Utils::ReadFromBuffer<unsigned int>(buffer_, offset);
+template <typename T>
+double DiskQalshAnnSearcher<T>::VerifyCandidate(Context& context, PointView<T> query_point,
+                                                unsigned int point_id) const {
+    if (!qalsh_config_.quantized) {
+        return distance_function_(GetBasePoint(context, point_id), query_point, context.candidates.best().distance);
+    }
 
-    unsigned int current_level = level;
-    unsigned int next_page_num = root_page_num;
-    while (current_level != 0) {
-        ReadPage(ifs, next_page_num);
-        InternalNode internal_node(buffer_);
+    // Score the candidate on its code, which needs neither a read nor full-precision arithmetic.
+    std::span<const uint8_t> code(codes_.data() + static_cast<size_t>(point_id) * num_dimensions_, num_dimensions_);
+    double distance = (quantizer_.*quantized_distance_)(context.shifted_query, code);
+    context.short_list.Add(AnnResult{.distance = distance, .point_id = point_id});
+    return distance;
+}
+
+template <typename T>
+void DiskQalshAnnSearcher<T>::VerifyPendingCandidates(Context& context, PointView<T> query_point) const {
+    // The candidates of a radius round are verified together at its end, in file order, so that the reads of their
+    // points are issued at once and move forward through the file.
+    std::vector<unsigned int>& pending = context.candidates.pending();
+    if (pending.empty()) {
+        return;
+    }
+    std::ranges::sort(pending);
+    if (!qalsh_config_.quantized) {
+        PrefetchPendingCandidates(context);
+    }
+    for (unsigned int point_id : pending) {
+        context.candidates.Resolve(
+            AnnResult{.distance = VerifyCandidate(context, query_point, point_id), .point_id = point_id});
+    }
+    pending.clear();
+}
+
+template <typename T>
+void DiskQalshAnnSearcher<T>::PrefetchPendingCandidates(Context& context) const {
+    std::span<const unsigned int> pending = context.candidates.pending();
+    size_t num_bytes = static_cast<size_t>(num_dimensions_) * sizeof(T);
+
+    // With direct I/O, read every page that the points span in one batch, so that viewing them hits the buffer pool.
+    if (direct_io_) {
+        std::vector<BufferPool::PageRequest>& page_requests = context.page_requests;
+        page_requests.clear();
+        for (unsigned int point_id : pending) {
+            size_t first_byte = static_cast<size_t>(point_id) * num_bytes;
+            auto first_page_num = static_cast<unsigned int>(first_byte / qalsh_config_.page_size);
+            auto last_page_num = static_cast<unsigned int>((first_byte + num_bytes - 1) / qalsh_config_.page_size);
+            if (!page_requests.empty()) {
+                first_page_num = std::max(first_page_num, page_requests.back().page_num + 1);
+            }
+            for (unsigned int page_num = first_page_num; page_num <= last_page_num; page_num++) {
+                size_t slot = page_requests.size() * qalsh_config_.page_size;
+                if (slot + qalsh_config_.page_size > context.batch_pages.size()) {
+                    buffer_pool_->ReadPages(page_requests, context.io_ring);
+                    page_requests.clear();
+                    slot = 0;
+                }
+                page_requests.emplace_back(BufferPool::PageRequest{
+                    .region_id = base_points_region_,
+                    .page_num = page_num,
+                    .page = std::span<char>(context.batch_pages.data() + slot, qalsh_config_.page_size)});
+            }
+        }
+        buffer_pool_->ReadPages(page_requests, context.io_ring);
+        return;
+    }
+
+    // Otherwise, merge the points that are close to each other into ranges, and have the kernel read the ranges of
+    // the mapping in the background.
+    size_t max_gap = Global::kMaxReadGapBytes / num_bytes;
+    unsigned int first_point_id = pending.front();
+    unsigned int last_point_id = pending.front();
+    for (unsigned int point_id : pending.subspan(1)) {
+        if (point_id - last_point_id > max_gap + 1) {
+            base_points_.Prefetch(first_point_id, last_point_id - first_point_id + 1);
+            first_point_id = point_id;
+        }
+        last_point_id = point_id;
+    }
+    base_points_.Prefetch(first_point_id, last_point_id - first_point_id + 1);
+}
+
+template <typename T>
+AnnResult DiskQalshAnnSearcher<T>::Rerank(Context& context, PointView<T> query_point) const {
+    // Visit the short-listed points in file order, so that the page faults only move forward.
+    std::span<AnnResult> short_list = context.short_list.results();
+    std::ranges::sort(short_list, {}, &AnnResult::point_id);
+
+    AnnResult result{.distance = std::numeric_limits<double>::max(), .point_id = 0};
+    for (const AnnResult& candidate : short_list) {
+        double distance = distance_function_(GetBasePoint(context, candidate.point_id), query_point, result.distance);
+        if (distance < result.distance) {
+            result = AnnResult{.distance = distance, .point_id = candidate.point_id};
+        }
+    }
+    return result;
+}
+
+template <typename T>
+void DiskQalshAnnSearcher<T>::PinTree(unsigned int table_id, PageBuffer& buffer) {
+    PinnedTree& tree = pinned_trees_[table_id];
+    ReadPage(table_id, 0, buffer.data());
+    std::memcpy(&tree.root_page_num, buffer.data(), sizeof(unsigned int));
+    std::memcpy(&tree.level, buffer.data() + sizeof(unsigned int), sizeof(unsigned int));
+    tree.num_pinned_levels = std::min(tree.level, num_pinned_levels_);
+
+    // Walk the pinned levels breadth first. The children of the nodes of one level are the nodes of the next level in
+    // the same order, so the index of a pinned child is known as soon as it is queued.
+    std::vector<unsigned int> level_page_nums{tree.root_page_num};
+    for (unsigned int depth = 0; depth < tree.num_pinned_levels; depth++) {
+        bool children_pinned = depth + 1 < tree.num_pinned_levels;
+        auto next_level_first_node = static_cast<unsigned int>(tree.nodes.size() + level_page_nums.size());
+        std::vector<unsigned int> next_level_page_nums;
+
+        for (unsigned int page_num : level_page_nums) {
+            ReadPage(table_id, page_num, buffer.data());
+            InternalNodeView<T> internal_node(buffer.data());
+            tree.nodes.emplace_back(
+                typename PinnedTree::Node{.first_key = static_cast<unsigned int>(tree.keys.size()),
+                                          .first_child = static_cast<unsigned int>(tree.children.size()),
+                                          .num_children = internal_node.num_children()});
+            for (unsigned int k = 0; k + 1 < internal_node.num_children(); k++) {
+                tree.keys.emplace_back(internal_node.key(k));
+            }
+            for (unsigned int k = 0; k < internal_node.num_children(); k++) {
+                unsigned int pointer = internal_node.pointer(k);
+                if (children_pinned) {
+                    tree.children.emplace_back(next_level_first_node +
+                                               static_cast<unsigned int>(next_level_page_nums.size()));
+                    next_level_page_nums.emplace_back(pointer);
+                } else {
+                    tree.children.emplace_back(pointer);
+                }
+            }
+        }
+        level_page_nums = std::move(next_level_page_nums);
+    }
+}
+
+template <typename T>
+unsigned int DiskQalshAnnSearcher<T>::FindLeafMayContainKey(unsigned int table_id, T key, char* frame) const {
+    const PinnedTree& tree = pinned_trees_[table_id];
+    unsigned int current_level = tree.level;
+    unsigned int next_page_num = tree.root_page_num;
+
+    // Descend the pinned levels without any I/O.
+    unsigned int node_id = 0;
+    for (unsigned int depth = 0; depth < tree.num_pinned_levels; depth++) {
+        const typename PinnedTree::Node& node = tree.nodes[node_id];
+        auto keys_begin = tree.keys.begin() + node.first_key;
+        auto it = std::upper_bound(keys_begin, keys_begin + (node.num_children - 1), key);
+        unsigned int child = tree.children[node.first_child + static_cast<unsigned int>(it - keys_begin)];
+        if (depth + 1 < tree.num_pinned_levels) {
+            node_id = child;
+        } else {
+            next_page_num = child;
+        }
+        current_level--;
+    }
 
-        auto it = std::ranges::upper_bound(internal_node.keys_, key);
-        auto index = static_cast<size_t>(std::distance(internal_node.keys_.begin(), it));
-        next_page_num = internal_node.pointers_.at(index);
+    // The unpinned internal levels pass through the frame, where the leaf is fetched afterwards.
+    while (current_level != 0) {
+        ReadPage(table_id, next_page_num, frame);
+        InternalNodeView<T> internal_node(frame);
+        next_page_num = internal_node.pointer(internal_node.FindChild(key));
 
         current_level--;
     }
-    return LocateLeafByPageNum(ifs, next_page_num);
+    return next_page_num;
+}
+
+template <typename T>
+void DiskQalshAnnSearcher<T>::ReadAhead(Context& context, unsigned int table_id, bool forward,
+                                        unsigned int page_num) const {
+    // The bulk loader writes the leaves on consecutive pages in key order, from page 1 on, so the next siblings of a
+    // leaf in either direction are the adjacent pages. The readahead window is the number of leaves this scan stepped
+    // to per query so far, and it is only refilled once the cursor reaches the last page already prefetched.
+    // Direct I/O bypasses the page cache that the kernel would prefetch into.
+    if (direct_io_) {
+        return;
+    }
+    unsigned int scan_id = 2 * table_id + (forward ? 1 : 0);
+    context.num_leaves_scanned[scan_id]++;
+    unsigned int num_pages = std::min(static_cast<unsigned int>(std::lround(context.mean_leaves_scanned[scan_id])),
+                                      Global::kMaxReadaheadLeaves);
+    unsigned int& frontier = context.readahead_frontiers[scan_id];
+    if (num_pages == 0) {
+        return;
+    }
+
+    if (forward) {
+        if (frontier != 0 && page_num < frontier) {
+            return;
+        }
+        buffer_pool_->Prefetch(table_id, page_num + 1, num_pages);
+        frontier = page_num + num_pages;
+    } else {
+        if ((frontier != 0 && page_num > frontier) || page_num <= 1) {
+            return;
+        }
+        unsigned int first_page_num = page_num > num_pages ? page_num - num_pages : 1;
+        buffer_pool_->Prefetch(table_id, first_page_num, page_num - first_page_num);
+        frontier = first_page_num;
+    }
+}
+
+template <typename T>
+void DiskQalshAnnSearcher<T>::UpdateReadAhead(Context& context) const {
+    for (size_t scan_id = 0; scan_id < context.num_leaves_scanned.size(); scan_id++) {
+        // Every query scales the weight of the previous ones by 1 - kReadaheadDecay.
+        double& mean = context.mean_leaves_scanned[scan_id];
+        mean += Global::kReadaheadDecay * (context.num_leaves_scanned[scan_id] - mean);
+        context.num_leaves_scanned[scan_id] = 0;
+        context.readahead_frontiers[scan_id] = 0;
+    }
+}
+
+template <typename T>
+PointView<T> DiskQalshAnnSearcher<T>::GetBasePoint(Context& context, unsigned int point_id) const {
+    if (!direct_io_) {
+        return base_points_.GetPoint(point_id);
+    }
+
+    // Read the pages that the point spans next to each other, and view the point inside them.
+    size_t num_bytes = static_cast<size_t>(num_dimensions_) * sizeof(T);
+    size_t first_byte = static_cast<size_t>(point_id) * num_bytes;
+    auto first_page_num = static_cast<unsigned int>(first_byte / qalsh_config_.page_size);
+    auto last_page_num = static_cast<unsigned int>((first_byte + num_bytes - 1) / qalsh_config_.page_size);
+    for (unsigned int page_num = first_page_num; page_num <= last_page_num; page_num++) {
+        buffer_pool_->ReadPage(
+            base_points_region_, page_num,
+            std::span<char>(context.point_pages.data() +
+                                static_cast<size_t>(page_num - first_page_num) * qalsh_config_.page_size,
+                            qalsh_config_.page_size));
+    }
+    return {reinterpret_cast<const T*>(context.point_pages.data() + first_byte % qalsh_config_.page_size),
+            num_dimensions_};
+}
+
+template <typename T>
+void DiskQalshAnnSearcher<T>::CheckDirectIo(const std::filesystem::path& file_path) const {
+    if (!direct_io_) {
+        return;
+    }
+    unsigned int alignment = Utils::GetDirectIoAlignment(file_path);
+    if (alignment == 0) {
+        spdlog::error("The file system of {} does not support direct I/O.", file_path.string());
+        return;
+    }
+    if (qalsh_config_.page_size % alignment != 0 || alignment > Global::kDirectIoAlignment) {
+        spdlog::error("The page size {} does not fit the direct I/O alignment of {} bytes of {}.",
+                      qalsh_config_.page_size, alignment, file_path.string());
+    }
+}
+
+template <typename T>
+char* DiskQalshAnnSearcher<T>::GetFrame(Context& context, unsigned int table_id) const {
+    return context.frames.data() + 2 * static_cast<size_t>(table_id) * qalsh_config_.page_size;
+}
+
+template <typename T>
+LeafNodeView<T> DiskQalshAnnSearcher<T>::LocateLeafByPageNum(unsigned int table_id, unsigned int page_num,
+                                                             char* frame) const {
+    ReadPage(table_id, page_num, frame);
+    return LeafNodeView<T>(frame, point_id_bits_);
+}
+
+template <typename T>
+void DiskQalshAnnSearcher<T>::ReadPage(unsigned int table_id, unsigned int page_num, char* frame) const {
+    buffer_pool_->ReadPage(table_id, page_num, std::span<char>(frame, qalsh_config_.page_size));
 }
 
-std::shared_ptr<LeafNode> DiskQalshAnnSearcher::LocateLeafByPageNum(std::ifstream& ifs, unsigned int page_num) {
-    ReadPage(ifs, page_num);
-    auto new_node_ptr = std::make_shared<LeafNode>(buffer_);
-    return new_node_ptr;
+template <typename T>
+void DiskQalshAnnSearcher<T>::LogStatistics() const {
+    size_t hits = buffer_pool_->hits();
+    size_t misses = buffer_pool_->misses();
+    double hit_rate = hits + misses == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(hits + misses);
+    spdlog::info("Buffer pool: {} hits, {} misses ({:.2f}% hit rate)", hits, misses,
+                 hit_rate * 100);  // NOLINT(readability-magic-numbers)
 }
 
-void DiskQalshAnnSearcher::ReadPage(std::ifstream& ifs, unsigned int page_num) {
-    ifs.seekg(static_cast<std::streamoff>(page_num) * qalsh_config_.page_size, std::ios::beg);
-    ifs.read(buffer_.data(), static_cast<std::streamsize>(qalsh_config_.page_size));
-}
\ No newline at end of file
+template class AnnSearcher<float>;
+template class AnnSearcher<double>;
+template class InMemoryLinearScanAnnSearcher<float>;
+template class InMemoryLinearScanAnnSearcher<double>;
+template class DiskLinearScanAnnSearcher<float>;
+template class DiskLinearScanAnnSearcher<double>;
+template class InMemoryQalshAnnSearcher<float>;
+template class InMemoryQalshAnnSearcher<double>;
+template class DiskQalshAnnSearcher<float>;
+template class DiskQalshAnnSearcher<double>;
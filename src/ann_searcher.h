@@ -1,99 +1,323 @@
 #ifndef ANN_SEARCHER_H_
 #define ANN_SEARCHER_H_
 
+#include <cstdint>
+#include <filesystem>
 #include <fstream>
+#include <functional>
+#include <limits>
 #include <memory>
+#include <optional>
 #include <random>
+#include <span>
+#include <type_traits>
 #include <vector>
 
 #include "b_plus_tree.h"
+#include "buffer_pool.h"
+#include "distance.h"
+#include "global.h"
+#include "mapped_point_set.h"
+#include "scalar_quantizer.h"
 #include "types.h"
 
 // ---------------------------------------------
 // AnnSearcher Definition
 // ---------------------------------------------
+// After Init, a searcher only holds the immutable index and may be shared between threads. Everything a query
+// mutates (scratch buffers, file handles) lives in a Context, and each thread must use its own. Searchers are templated
+// on the scalar type of the points, so the index of a float32 dataset is built and searched without widening.
+template <typename T>
 class AnnSearcher {
    public:
+    class Context {
+       public:
+        virtual ~Context() = default;
+    };
+
     virtual ~AnnSearcher() = default;
     virtual void Init(const PointSetMetadata& base_metadata, double norm_order) = 0;
-    virtual AnnResult Search(const Point& query_point) = 0;
+    virtual std::unique_ptr<Context> CreateContext() const;
+    virtual AnnResult Search(PointView<T> query_point, Context& context) const = 0;
+    virtual std::vector<AnnResult> SearchBatch(const PointMatrixRef<T>& query_points, Context& context) const;
+    // Logs what the searcher has counted over all the queries so far, if anything.
+    virtual void LogStatistics() const {}
 };
 
 // ---------------------------------------------
 // InMemoryLinearScanAnnSearcher Definition
 // ---------------------------------------------
-class InMemoryLinearScanAnnSearcher : public AnnSearcher {
+template <typename T>
+class InMemoryLinearScanAnnSearcher : public AnnSearcher<T> {
    public:
     InMemoryLinearScanAnnSearcher() = default;
     void Init(const PointSetMetadata& base_metadata, double norm_order) override;
-    AnnResult Search(const Point& query_point) override;
+    AnnResult Search(PointView<T> query_point, typename AnnSearcher<T>::Context& context) const override;
 
    private:
-    std::vector<Point> base_points_;
-    double norm_order_{0.0};
+    PointMatrix<T> base_points_;
+    DistanceFunction<T> distance_function_{nullptr};
 };
 
 // ---------------------------------------------
 // DiskLinearScanAnnSearcher Definition
 // ---------------------------------------------
-class DiskLinearScanAnnSearcher : public AnnSearcher {
+template <typename T>
+class DiskLinearScanAnnSearcher : public AnnSearcher<T> {
    public:
     DiskLinearScanAnnSearcher() = default;
     void Init(const PointSetMetadata& base_metadata, double norm_order) override;
-    AnnResult Search(const Point& query_point) override;
+    AnnResult Search(PointView<T> query_point, typename AnnSearcher<T>::Context& context) const override;
+    std::vector<AnnResult> SearchBatch(const PointMatrixRef<T>& query_points,
+                                       typename AnnSearcher<T>::Context& context) const override;
 
    private:
-    std::ifstream base_file_;
+    MappedPointSet<T> base_points_;
     unsigned int num_points_{0};
     unsigned int num_dimensions_{0};
-    double norm_order_{0.0};
+    DistanceFunction<T> distance_function_{nullptr};
+};
+
+// ---------------------------------------------
+// CollisionCounter Definition
+// ---------------------------------------------
+// Per-point collision counts that are reset in O(1) between queries. Each count is stamped with the epoch of the query
+// that last touched it, and a count from an older epoch reads as zero, so the O(num_points) array is only cleared when
+// the epoch wraps around.
+class CollisionCounter {
+   public:
+    CollisionCounter() = default;
+    CollisionCounter(unsigned int num_points);
+    void Reset();
+    unsigned int Increment(unsigned int point_id);
+
+   private:
+    struct Entry {
+        unsigned int epoch{0};
+        unsigned int count{0};
+    };
+
+    std::vector<Entry> entries_;
+    unsigned int epoch_{0};
+};
+
+// ---------------------------------------------
+// CandidateSet Definition
+// ---------------------------------------------
+// The QALSH stopping rules only look at the number of verified candidates and the best of them, so there is no need
+// to keep the candidates themselves.
+class CandidateSet {
+   public:
+    void Add(const AnnResult& candidate);
+    // A pending candidate counts toward size() at once, but only competes for best() once it is resolved with its
+    // distance, so that the distances of several candidates can be computed together.
+    void AddPending(unsigned int point_id);
+    void Resolve(const AnnResult& candidate);
+    void Clear();
+    [[nodiscard]] size_t size() const { return size_; }
+    [[nodiscard]] bool empty() const { return size_ == 0; }
+    [[nodiscard]] const AnnResult& best() const { return best_; }
+    [[nodiscard]] std::vector<unsigned int>& pending() { return pending_; }
+
+   private:
+    size_t size_{0};
+    size_t num_resolved_{0};
+    AnnResult best_{.distance = std::numeric_limits<double>::max(), .point_id = 0};
+    std::vector<unsigned int> pending_;
+};
+
+// ---------------------------------------------
+// ShortList Definition
+// ---------------------------------------------
+// Keeps the capacity candidates with the smallest distances seen so far, as a max-heap on the distance.
+class ShortList {
+   public:
+    ShortList() = default;
+    ShortList(size_t capacity);
+    void Add(const AnnResult& candidate);
+    void Clear();
+    [[nodiscard]] std::span<AnnResult> results() { return heap_; }
+
+   private:
+    size_t capacity_{0};
+    std::vector<AnnResult> heap_;
 };
 
 // ---------------------------------------------
 // InMemoryQalshAnnSearcher Definition
 // ---------------------------------------------
-class InMemoryQalshAnnSearcher : public AnnSearcher {
+template <typename T>
+class InMemoryQalshAnnSearcher : public AnnSearcher<T> {
    public:
+    class Context : public AnnSearcher<T>::Context {
+       public:
+        CollisionCounter collision_counter;
+        CandidateSet candidates;
+        std::vector<std::optional<unsigned int>> lefts;
+        std::vector<std::optional<unsigned int>> rights;
+        std::vector<bool> finish;
+    };
+
     InMemoryQalshAnnSearcher(double approximation_ratio);
     void Init(const PointSetMetadata& base_metadata, double norm_order) override;
-    AnnResult Search(const Point& query_point) override;
+    std::unique_ptr<typename AnnSearcher<T>::Context> CreateContext() const override;
+    AnnResult Search(PointView<T> query_point, typename AnnSearcher<T>::Context& context) const override;
+    std::vector<AnnResult> SearchBatch(const PointMatrixRef<T>& query_points,
+                                       typename AnnSearcher<T>::Context& context) const override;
 
    private:
+    AnnResult SearchWithKeys(PointView<T> query_point, std::span<const T> keys, Context& context) const;
+
     std::mt19937 gen_;
-    std::vector<Point> base_points_;
+    PointMatrix<T> base_points_;
     double norm_order_{0.0};
+    DistanceFunction<T> distance_function_{nullptr};
     QalshConfig qalsh_config_;
-    std::vector<Point> dot_vectors_;
-    std::vector<std::vector<DotProductPointIdPair>> hash_tables_;
+    PointMatrix<T> dot_vectors_;
+    std::vector<std::vector<DotProductPointIdPair<T>>> hash_tables_;
 };
 
 // ---------------------------------------------
 // DiskQalshAnnSearcher Definition
 // ---------------------------------------------
-class DiskQalshAnnSearcher : public AnnSearcher {
+template <typename T>
+class DiskQalshAnnSearcher : public AnnSearcher<T> {
    public:
+    // A scan position in a leaf. The view reads the leaf in place from a page frame of the context.
     struct SearchRecord {
-        std::shared_ptr<LeafNode> leaf_node;
+        LeafNodeView<T> leaf_node;
         unsigned int index{0};
     };
 
-    DiskQalshAnnSearcher() = default;
+    class Context : public AnnSearcher<T>::Context {
+       public:
+        // Two page frames per hash table, one for the leaf under the left scan and one for the right scan.
+        PageBuffer frames;
+        // Only used with direct I/O: the pages that hold the base point being verified, and the pages that the points
+        // of a batch of candidates are read into at once.
+        PageBuffer point_pages;
+        PageBuffer batch_pages;
+        CollisionCounter collision_counter;
+        CandidateSet candidates;
+        std::vector<float> shifted_query;
+        ShortList short_list;
+        std::vector<std::optional<SearchRecord>> lefts;
+        std::vector<std::optional<SearchRecord>> rights;
+        std::vector<bool> finish;
+        // The leaves where the scans of all hash tables start are fetched in one batch through the ring.
+        IoRing io_ring;
+        std::vector<BufferPool::PageRequest> page_requests;
+        // Per scan, i.e. the left and the right scan of every hash table: the number of leaves it stepped to in the
+        // current query and on average over the previous ones, and the farthest page it prefetched.
+        std::vector<unsigned int> num_leaves_scanned;
+        std::vector<double> mean_leaves_scanned;
+        std::vector<unsigned int> readahead_frontiers;
+    };
+
+    // Only the top num_pinned_levels internal levels of each B+ tree are kept in memory; the levels below them are
+    // read through the buffer pool.
+    // With direct_io, the index and the base points are read with O_DIRECT, so that the buffer pool is the only cache
+    // they go through and the memory they take is bounded by it.
+    explicit DiskQalshAnnSearcher(unsigned int num_pinned_levels = Global::kDefaultNumPinnedLevels,
+                                  bool direct_io = false);
     void Init(const PointSetMetadata& base_metadata, double norm_order) override;
-    AnnResult Search(const Point& query_point) override;
+    std::unique_ptr<typename AnnSearcher<T>::Context> CreateContext() const override;
+    AnnResult Search(PointView<T> query_point, typename AnnSearcher<T>::Context& context) const override;
+    std::vector<AnnResult> SearchBatch(const PointMatrixRef<T>& query_points,
+                                       typename AnnSearcher<T>::Context& context) const override;
+    void LogStatistics() const override;
 
    private:
-    std::shared_ptr<LeafNode> LocateLeafMayContainKey(std::ifstream& ifs, double key);
-    std::shared_ptr<LeafNode> LocateLeafByPageNum(std::ifstream& ifs, unsigned int page_num);
-    void ReadPage(std::ifstream& ifs, unsigned int page_num);
+    // The header and the top internal levels of a B+ tree. The nodes are stored in breadth-first order, and a child
+    // pointer holds the index of the child node while the child is pinned, and its page number once it is not.
+    struct PinnedTree {
+        struct Node {
+            unsigned int first_key{0};
+            unsigned int first_child{0};
+            unsigned int num_children{0};
+        };
+
+        unsigned int root_page_num{0};
+        unsigned int level{0};
+        unsigned int num_pinned_levels{0};
+        std::vector<Node> nodes;
+        std::vector<T> keys;
+        std::vector<unsigned int> children;
+    };
 
-    std::ifstream base_file_;
+    void PinTree(unsigned int table_id, PageBuffer& buffer);
+    AnnResult SearchWithKeys(PointView<T> query_point, std::span<const T> keys, Context& context) const;
+    double VerifyCandidate(Context& context, PointView<T> query_point, unsigned int point_id) const;
+    void VerifyPendingCandidates(Context& context, PointView<T> query_point) const;
+    void PrefetchPendingCandidates(Context& context) const;
+    AnnResult Rerank(Context& context, PointView<T> query_point) const;
+    // Returns the page number of the leaf that may contain key. The unpinned internal levels are read into the frame.
+    unsigned int FindLeafMayContainKey(unsigned int table_id, T key, char* frame) const;
+    PointView<T> GetBasePoint(Context& context, unsigned int point_id) const;
+    // Fails if the file cannot be read with direct I/O in pages of the index.
+    void CheckDirectIo(const std::filesystem::path& file_path) const;
+    // The frame of the left scan of the hash table, which is followed by the frame of its right scan.
+    char* GetFrame(Context& context, unsigned int table_id) const;
+    // Prefetches the sibling leaves that the scan is expected to step to after the leaf page_num.
+    void ReadAhead(Context& context, unsigned int table_id, bool forward, unsigned int page_num) const;
+    void UpdateReadAhead(Context& context) const;
+    LeafNodeView<T> LocateLeafByPageNum(unsigned int table_id, unsigned int page_num, char* frame) const;
+    void ReadPage(unsigned int table_id, unsigned int page_num, char* frame) const;
+
+    // The base points, or their reordered copy, in which case point_ids_ maps a position in the copy to a point id.
+    MappedPointSet<T> base_points_;
+    std::vector<unsigned int> point_ids_;
+    // The pages of all the B+ trees, and with direct I/O of the base points, cached across tables, radius rounds,
+    // queries and threads.
+    std::unique_ptr<BufferPool> buffer_pool_;
+    unsigned int base_points_region_{0};
+    unsigned int num_pinned_levels_;
+    bool direct_io_;
+    std::vector<PinnedTree> pinned_trees_;
+    // Number of bits of a point id in a compressed leaf, or 0 if the leaves are not compressed.
+    unsigned int point_id_bits_{0};
     unsigned int num_points_{0};
     unsigned int num_dimensions_{0};
     double norm_order_{0.0};
+    DistanceFunction<T> distance_function_{nullptr};
     QalshConfig qalsh_config_;
-    std::vector<Point> dot_vectors_;
-    std::vector<std::ifstream> hash_tables_;
-    std::vector<char> buffer_;
+    PointMatrix<T> dot_vectors_;
+
+    // Only used when the index is quantized: the codes of all base points are kept in memory.
+    ScalarQuantizer quantizer_;
+    std::vector<uint8_t> codes_;
+    QuantizedDistanceFunction quantized_distance_{nullptr};
+};
+
+// ---------------------------------------------
+// AnnSearcherFactory Definition
+// ---------------------------------------------
+// The scalar type of a dataset is only known once its metadata has been read, so the command line hands estimators a
+// factory that can create the chosen searcher for either type.
+class AnnSearcherFactory {
+   public:
+    template <template <typename> class Searcher, typename... Args>
+    static AnnSearcherFactory Of(Args... args) {
+        AnnSearcherFactory factory;
+        factory.float32_creator_ = [=]() { return std::make_unique<Searcher<float>>(args...); };
+        factory.float64_creator_ = [=]() { return std::make_unique<Searcher<double>>(args...); };
+        return factory;
+    }
+
+    template <typename T>
+    [[nodiscard]] std::unique_ptr<AnnSearcher<T>> Create() const {
+        if constexpr (std::is_same_v<T, float>) {
+            return float32_creator_();
+        } else {
+            return float64_creator_();
+        }
+    }
+
+    explicit operator bool() const { return static_cast<bool>(float64_creator_); }
+
+   private:
+    std::function<std::unique_ptr<AnnSearcher<float>>()> float32_creator_;
+    std::function<std::unique_ptr<AnnSearcher<double>>()> float64_creator_;
 };
 
-#endif
\ No newline at end of file
+#endif
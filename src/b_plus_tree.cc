@@ -3,31 +3,37 @@
 #include <spdlog/spdlog.h>
 
 #include <algorithm>
+#include <bit>
 #include <cmath>
 #include <cstddef>
 #include <cstring>
 #include <vector>
 
+#include "global.h"
 #include "utils.h"
 
 // ---------- InternalNode Implementation ----------
-InternalNode::InternalNode(unsigned int order) {
+template <typename T>
+InternalNode<T>::InternalNode(unsigned int order) {
     keys_.reserve(order - 1);
     pointers_.reserve(order);
 };
 
-InternalNode::InternalNode(const std::vector<char>& buffer) {
+template <typename T>
+InternalNode<T>::InternalNode(const std::vector<char>& buffer) {
     size_t offset = 0;
 
     num_children_ = Utils::ReadFromBuffer<unsigned int>(buffer, offset);
 
-    keys_ = Utils::ReadVectorFromBuffer<double>(buffer, offset, num_children_ - 1);
+    keys_ = Utils::ReadVectorFromBuffer<T>(buffer, offset, num_children_ - 1);
     pointers_ = Utils::ReadVectorFromBuffer<unsigned int>(buffer, offset, num_children_);
 };
 
-size_t InternalNode::GetHeaderSize() { return sizeof(num_children_); }
+template <typename T>
+size_t InternalNode<T>::GetHeaderSize() { return sizeof(num_children_); }
 
-void InternalNode::Serialize(std::vector<char>& buffer) const {
+template <typename T>
+void InternalNode<T>::Serialize(std::vector<char>& buffer) const {
     size_t offset = 0;
     Utils::WriteToBuffer(buffer, offset, num_children_);
 
@@ -40,27 +46,65 @@ void InternalNode::Serialize(std::vector<char>& buffer) const {
 }
 
 // ---------- LeafNode Implementation ----------
-LeafNode::LeafNode(unsigned int order) {
+template <typename T>
+LeafNode<T>::LeafNode(unsigned int order) {
     keys_.reserve(order);
     values_.reserve(order);
 };
 
-LeafNode::LeafNode(const std::vector<char>& buffer) {
+template <typename T>
+LeafNode<T>::LeafNode(const std::vector<char>& buffer) {
     size_t offset = 0;
 
     num_entries_ = Utils::ReadFromBuffer<unsigned int>(buffer, offset);
     prev_leaf_page_num_ = Utils::ReadFromBuffer<unsigned int>(buffer, offset);
     next_leaf_page_num_ = Utils::ReadFromBuffer<unsigned int>(buffer, offset);
 
-    keys_ = Utils::ReadVectorFromBuffer<double>(buffer, offset, num_entries_);
+    keys_ = Utils::ReadVectorFromBuffer<T>(buffer, offset, num_entries_);
     values_ = Utils::ReadVectorFromBuffer<unsigned int>(buffer, offset, num_entries_);
 }
 
-size_t LeafNode::GetHeaderSize() {
+template <typename T>
+size_t LeafNode<T>::GetHeaderSize() {
     return sizeof(num_entries_) + sizeof(prev_leaf_page_num_) + sizeof(next_leaf_page_num_);
 }
 
-void LeafNode::Serialize(std::vector<char>& buffer) const {
+template <typename T>
+unsigned int LeafNode<T>::GetPointIdBits(unsigned int num_points) {
+    return std::max(1U, static_cast<unsigned int>(std::bit_width(std::max(num_points, 1U) - 1)));
+}
+
+template <typename T>
+size_t LeafNode<T>::GetCompressedHeaderSize() {
+    return GetHeaderSize() + sizeof(T);
+}
+
+template <typename T>
+void LeafNode<T>::SerializeCompressed(std::vector<char>& buffer, unsigned int point_id_bits) const {
+    size_t offset = 0;
+    Utils::WriteToBuffer(buffer, offset, num_entries_);
+    Utils::WriteToBuffer(buffer, offset, prev_leaf_page_num_);
+    Utils::WriteToBuffer(buffer, offset, next_leaf_page_num_);
+    Utils::WriteToBuffer(buffer, offset, keys_.front());
+
+    // The keys are sorted, so every offset from the first key is non-negative and rounding keeps them sorted.
+    for (auto key : keys_) {
+        Utils::WriteToBuffer(buffer, offset, static_cast<float>(key - keys_.front()));
+    }
+
+    // Pack the point ids. A 64-bit word always covers one id, whatever its bit offset within its first byte.
+    std::fill(buffer.begin() + static_cast<std::ptrdiff_t>(offset), buffer.end(), 0);
+    for (size_t i = 0; i < values_.size(); i++) {
+        size_t bit = i * point_id_bits;
+        uint64_t word = 0;
+        std::memcpy(&word, &buffer[offset + bit / 8], sizeof(word));
+        word |= static_cast<uint64_t>(values_[i]) << (bit % 8);
+        std::memcpy(&buffer[offset + bit / 8], &word, sizeof(word));
+    }
+}
+
+template <typename T>
+void LeafNode<T>::Serialize(std::vector<char>& buffer) const {
     size_t offset = 0;
     Utils::WriteToBuffer(buffer, offset, num_entries_);
     Utils::WriteToBuffer(buffer, offset, prev_leaf_page_num_);
@@ -74,82 +118,148 @@ void LeafNode::Serialize(std::vector<char>& buffer) const {
     }
 }
 
-// ---------- BPlusTreeBulkLoader Implementation ----------
-BPlusTreeBulkLoader::BPlusTreeBulkLoader(const std::filesystem::path& file_path, unsigned int page_size)
-    : page_size_(page_size) {
-    ofs_.open(file_path, std::ios::binary | std::ios::trunc);
-    if (!ofs_) {
-        spdlog::error("Failed to open file: {}", file_path.string());
+// ---------- Node View Implementation ----------
+template <typename T>
+unsigned int InternalNodeView<T>::FindChild(T key) const {
+    unsigned int low = 0;
+    unsigned int high = num_children_ - 1;
+    while (low < high) {
+        unsigned int mid = low + (high - low) / 2;
+        if (key < this->key(mid)) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
     }
+    return low;
+}
+
+template <typename T>
+unsigned int LeafNodeView<T>::LowerBound(T key) const {
+    unsigned int low = 0;
+    unsigned int high = num_entries_;
+    while (low < high) {
+        unsigned int mid = low + (high - low) / 2;
+        if (this->key(mid) < key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
 
-    internal_node_order_ = static_cast<unsigned int>((page_size - InternalNode::GetHeaderSize() + sizeof(double)) /
-                                                     (sizeof(double) + sizeof(unsigned int)));
+// ---------- BPlusTreeBulkLoader Implementation ----------
+template <typename T>
+BPlusTreeBulkLoader<T>::BPlusTreeBulkLoader(std::ostream& ofs, std::streamoff base_offset, unsigned int page_size,
+                                            bool compressed_leaves)
+    : ofs_(ofs), base_offset_(base_offset), page_size_(page_size), compressed_leaves_(compressed_leaves) {
+    internal_node_order_ = static_cast<unsigned int>((page_size - InternalNode<T>::GetHeaderSize() + sizeof(T)) /
+                                                     (sizeof(T) + sizeof(unsigned int)));
     leaf_node_order_ =
-        static_cast<unsigned int>((page_size - LeafNode::GetHeaderSize()) / (sizeof(double) + sizeof(unsigned int)));
+        static_cast<unsigned int>((page_size - LeafNode<T>::GetHeaderSize()) / (sizeof(T) + sizeof(unsigned int)));
     buffer_.resize(page_size_, 0);
+    write_buffer_.reserve(std::max<size_t>(page_size_, Global::kWriteBufferBytes / page_size_ * page_size_));
+}
+
+template <typename T>
+void BPlusTreeBulkLoader<T>::Build(const std::vector<DotProductPointIdPair<T>>& data) {
+    Begin(data.size());
+    for (const DotProductPointIdPair<T>& pair : data) {
+        Add(pair);
+    }
+    Finish();
 }
 
-void BPlusTreeBulkLoader::Build(const std::vector<DotProductPointIdPair>& data) {
-    std::vector<KeyPageNumPair> parent_level_entries;
+template <typename T>
+void BPlusTreeBulkLoader<T>::Begin(size_t num_entries) {
+    // Reset everything a previous tree left behind, so that a loader can build several trees in turn.
+    num_page_ = 0;
+    next_page_num_ = 0;
+    root_page_num_ = 0;
+    level_ = 0;
+    num_entries_ = num_entries;
+    num_added_ = 0;
+    parent_level_entries_.clear();
+    write_buffer_.clear();
+    num_flushed_pages_ = 0;
+
+    // A compressed entry takes a float32 key offset and point_id_bits bits. The last 8 bytes of the page are left free
+    // so that unpacking the last point id never reads past the page.
+    if (compressed_leaves_) {
+        point_id_bits_ = LeafNode<T>::GetPointIdBits(static_cast<unsigned int>(num_entries));
+        leaf_node_order_ = static_cast<unsigned int>((page_size_ - LeafNode<T>::GetCompressedHeaderSize() - 8) * 8 /
+                                                     (sizeof(float) * 8 + point_id_bits_));
+    }
+    leaf_node_ = LeafNode<T>(leaf_node_order_);
 
     // Reserve page 0 for the file header
+    ofs_.seekp(base_offset_);
     AllocatePage();
+}
 
-    // Build the leaf nodes
-    unsigned int prev_leaf_page_num = 0;
-    unsigned int new_leaf_page_num = 0;
-    size_t data_idx = 0;
+template <typename T>
+void BPlusTreeBulkLoader<T>::Add(const DotProductPointIdPair<T>& pair) {
+    leaf_node_.keys_.emplace_back(pair.dot_product);
+    leaf_node_.values_.emplace_back(pair.point_id);
+    leaf_node_.num_entries_++;
+    num_added_++;
 
-    while (data_idx < data.size()) {
-        LeafNode new_leaf_node(leaf_node_order_);
-        new_leaf_node.prev_leaf_page_num_ = prev_leaf_page_num;
+    if (leaf_node_.num_entries_ == leaf_node_order_ || num_added_ == num_entries_) {
+        WriteLeaf();
+    }
+}
 
-        size_t chunk_end = std::min(data_idx + leaf_node_order_, data.size());
-        for (size_t i = data_idx; i < chunk_end; i++) {
-            new_leaf_node.keys_.emplace_back(data[i].dot_product);
-            new_leaf_node.values_.emplace_back(data[i].point_id);
-            new_leaf_node.num_entries_++;
-        }
-        data_idx = chunk_end;
+template <typename T>
+void BPlusTreeBulkLoader<T>::WriteLeaf() {
+    // Serialize the leaf node and write it to the file
+    unsigned int new_leaf_page_num = AllocatePage();
+    leaf_node_.next_leaf_page_num_ = (num_added_ < num_entries_) ? next_page_num_ : 0;
+    if (compressed_leaves_) {
+        leaf_node_.SerializeCompressed(buffer_, point_id_bits_);
+    } else {
+        leaf_node_.Serialize(buffer_);
+    }
+    WritePage(new_leaf_page_num);
 
-        // Serialize the leaf node and write it to the file
-        new_leaf_page_num = AllocatePage();
-        new_leaf_node.next_leaf_page_num_ = (data_idx < data.size()) ? next_page_num_ : 0;
-        new_leaf_node.Serialize(buffer_);
-        WritePage(new_leaf_page_num);
+    // Add entry to the parent level
+    parent_level_entries_.emplace_back(leaf_node_.keys_.front(), new_leaf_page_num);
+    root_page_num_ = new_leaf_page_num;
 
-        // Add entry to the parent level
-        parent_level_entries.emplace_back(new_leaf_node.keys_.front(), new_leaf_page_num);
+    // Start the next leaf
+    leaf_node_ = LeafNode<T>(leaf_node_order_);
+    leaf_node_.prev_leaf_page_num_ = new_leaf_page_num;
+}
 
-        // Update the previous leaf page number
-        prev_leaf_page_num = new_leaf_page_num;
+template <typename T>
+void BPlusTreeBulkLoader<T>::Finish() {
+    if (num_added_ != num_entries_) {
+        spdlog::error("The B+ tree got {} of its {} entries.", num_added_, num_entries_);
     }
 
-    root_page_num_ = new_leaf_page_num;
-
     unsigned int new_internal_page_num = 0;
 
     // Build the internal nodes
-    while (parent_level_entries.size() > 1) {
+    while (parent_level_entries_.size() > 1) {
         level_++;
 
-        std::vector<KeyPageNumPair> next_parent_level_entries;
+        std::vector<KeyPageNumPair<T>> next_parent_level_entries;
         size_t entry_idx = 0;
 
-        while (entry_idx < parent_level_entries.size()) {
-            double separator_key_for_next_level = parent_level_entries[entry_idx].key;
+        while (entry_idx < parent_level_entries_.size()) {
+            T separator_key_for_next_level = parent_level_entries_[entry_idx].key;
 
-            InternalNode new_internal_node(internal_node_order_);
+            InternalNode<T> new_internal_node(internal_node_order_);
 
             // First pointer in the node has no preceding key
-            new_internal_node.pointers_.emplace_back(parent_level_entries[entry_idx].page_num);
+            new_internal_node.pointers_.emplace_back(parent_level_entries_[entry_idx].page_num);
             new_internal_node.num_children_++;
 
-            size_t chunk_end = std::min(entry_idx + internal_node_order_, parent_level_entries.size());
+            size_t chunk_end = std::min(entry_idx + internal_node_order_, parent_level_entries_.size());
 
             for (size_t i = entry_idx + 1; i < chunk_end; i++) {
-                new_internal_node.keys_.emplace_back(parent_level_entries[i].key);
-                new_internal_node.pointers_.emplace_back(parent_level_entries[i].page_num);
+                new_internal_node.keys_.emplace_back(parent_level_entries_[i].key);
+                new_internal_node.pointers_.emplace_back(parent_level_entries_[i].page_num);
                 new_internal_node.num_children_++;
             }
             entry_idx = chunk_end;
@@ -163,12 +273,14 @@ void BPlusTreeBulkLoader::Build(const std::vector<DotProductPointIdPair>& data)
             next_parent_level_entries.emplace_back(separator_key_for_next_level, new_internal_page_num);
 
             // Update the parent level entries
-            parent_level_entries = next_parent_level_entries;
+            parent_level_entries_ = next_parent_level_entries;
         }
     }
 
     root_page_num_ = new_internal_page_num == 0 ? root_page_num_ : new_internal_page_num;
 
+    FlushPages();
+
     // write the header
     size_t offset = 0;
 
@@ -178,18 +290,44 @@ void BPlusTreeBulkLoader::Build(const std::vector<DotProductPointIdPair>& data)
     WritePage(0);
 }
 
-unsigned int BPlusTreeBulkLoader::AllocatePage() {
-    unsigned int new_page_num = next_page_num_++;
-
-    ofs_.seekp(static_cast<std::streamoff>(new_page_num * page_size_));
-    std::vector<char> empty_page(page_size_, 0);
-    ofs_.write(empty_page.data(), static_cast<std::streamsize>(empty_page.size()));
+template <typename T>
+unsigned int BPlusTreeBulkLoader<T>::AllocatePage() {
+    if (write_buffer_.size() == write_buffer_.capacity()) {
+        FlushPages();
+    }
+    write_buffer_.resize(write_buffer_.size() + page_size_, 0);
     num_page_++;
 
-    return new_page_num;
+    return next_page_num_++;
 }
 
-void BPlusTreeBulkLoader::WritePage(unsigned int page_num) {
-    ofs_.seekp(static_cast<std::streamoff>(page_num * page_size_));
+template <typename T>
+void BPlusTreeBulkLoader<T>::WritePage(unsigned int page_num) {
+    if (page_num >= num_flushed_pages_) {
+        std::memcpy(write_buffer_.data() + static_cast<size_t>(page_num - num_flushed_pages_) * page_size_,
+                    buffer_.data(), page_size_);
+        return;
+    }
+
+    ofs_.seekp(base_offset_ + static_cast<std::streamoff>(page_num) * page_size_);
     ofs_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    ofs_.seekp(base_offset_ + static_cast<std::streamoff>(num_flushed_pages_) * page_size_);
 }
+
+template <typename T>
+void BPlusTreeBulkLoader<T>::FlushPages() {
+    ofs_.write(write_buffer_.data(), static_cast<std::streamsize>(write_buffer_.size()));
+    num_flushed_pages_ += static_cast<unsigned int>(write_buffer_.size() / page_size_);
+    write_buffer_.clear();
+}
+
+template class InternalNode<float>;
+template class InternalNode<double>;
+template class LeafNode<float>;
+template class LeafNode<double>;
+template class InternalNodeView<float>;
+template class InternalNodeView<double>;
+template class LeafNodeView<float>;
+template class LeafNodeView<double>;
+template class BPlusTreeBulkLoader<float>;
+template class BPlusTreeBulkLoader<double>;
@@ -2,16 +2,24 @@
 #define B_PLUS_TREE_H_
 
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <ostream>
 #include <vector>
 
+#include "buffer_pool.h"
 #include "types.h"
 
+template <typename T>
+class BPlusTreeBulkLoader;
+
+// The keys are stored as T, so a float32 index packs more entries into each page.
+template <typename T>
 class InternalNode {
    public:
-    friend class BPlusTreeBulkLoader;
-    friend class DiskQalshAnnSearcher;
+    friend class BPlusTreeBulkLoader<T>;
     InternalNode(unsigned int order);
     InternalNode(const std::vector<char>& buffer);
 
@@ -23,20 +31,27 @@ class InternalNode {
     unsigned int num_children_{0};
 
     // Data
-    std::vector<double> keys_;
+    std::vector<T> keys_;
     std::vector<unsigned int> pointers_;
 };
 
+// A compressed leaf stores its first key in the header, the other keys as float32 offsets from it, and the point ids
+// bit-packed on GetPointIdBits(num_points) bits each. This roughly doubles the number of entries per page of a float64
+// index, at the cost of keys that are only accurate to float32 within a leaf.
+template <typename T>
 class LeafNode {
    public:
-    friend class BPlusTreeBulkLoader;
-    friend class DiskQalshAnnSearcher;
+    friend class BPlusTreeBulkLoader<T>;
     LeafNode(unsigned int order);
     LeafNode(const std::vector<char>& buffer);
 
+    static unsigned int GetPointIdBits(unsigned int num_points);
+    static size_t GetCompressedHeaderSize();
+
    private:
     static size_t GetHeaderSize();
     void Serialize(std::vector<char>& buffer) const;
+    void SerializeCompressed(std::vector<char>& buffer, unsigned int point_id_bits) const;
 
     // Header
     unsigned int num_entries_{0};
@@ -44,21 +59,124 @@ class LeafNode {
     unsigned int next_leaf_page_num_{0};
 
     // Data
-    std::vector<double> keys_;
+    std::vector<T> keys_;
     std::vector<unsigned int> values_;
 };
 
-class BPlusTreeBulkLoader {
+// Non-owning views that read a serialized node in place from its page, without copying or allocating anything. The
+// keys that follow the node header are not necessarily aligned for T, so every field is loaded through memcpy.
+template <typename T>
+class InternalNodeView {
+   public:
+    explicit InternalNodeView(const char* page) : page_(page) {
+        std::memcpy(&num_children_, page_, sizeof(unsigned int));
+    }
+
+    [[nodiscard]] unsigned int num_children() const { return num_children_; }
+    [[nodiscard]] T key(unsigned int index) const { return Load<T>(sizeof(unsigned int) + index * sizeof(T)); }
+    [[nodiscard]] unsigned int pointer(unsigned int index) const {
+        return Load<unsigned int>(sizeof(unsigned int) + (num_children_ - 1) * sizeof(T) +
+                                  index * sizeof(unsigned int));
+    }
+
+    // Index of the child whose subtree may contain key, i.e. the number of keys that are not greater than key.
+    [[nodiscard]] unsigned int FindChild(T key) const;
+
+   private:
+    template <typename U>
+    [[nodiscard]] U Load(size_t offset) const {
+        U value;
+        std::memcpy(&value, page_ + offset, sizeof(U));
+        return value;
+    }
+
+    const char* page_;
+    unsigned int num_children_{0};
+};
+
+// A leaf view reads the compressed format when it is given the number of bits of a point id, and the plain one when
+// that number is 0.
+template <typename T>
+class LeafNodeView {
    public:
-    BPlusTreeBulkLoader(const std::filesystem::path& file_path, unsigned int page_size);
+    LeafNodeView() = default;
+    explicit LeafNodeView(const char* page, unsigned int point_id_bits = 0)
+        : page_(page), point_id_bits_(point_id_bits) {
+        std::memcpy(&num_entries_, page_, sizeof(unsigned int));
+        std::memcpy(&prev_leaf_page_num_, page_ + sizeof(unsigned int), sizeof(unsigned int));
+        std::memcpy(&next_leaf_page_num_, page_ + 2 * sizeof(unsigned int), sizeof(unsigned int));
+        if (point_id_bits_ != 0) {
+            first_key_ = Load<T>(kHeaderSize);
+            values_offset_ = kHeaderSize + sizeof(T) + num_entries_ * sizeof(float);
+        } else {
+            values_offset_ = kHeaderSize + num_entries_ * sizeof(T);
+        }
+    }
+
+    [[nodiscard]] unsigned int num_entries() const { return num_entries_; }
+    [[nodiscard]] unsigned int prev_leaf_page_num() const { return prev_leaf_page_num_; }
+    [[nodiscard]] unsigned int next_leaf_page_num() const { return next_leaf_page_num_; }
+    [[nodiscard]] T key(unsigned int index) const {
+        if (point_id_bits_ != 0) {
+            return first_key_ + static_cast<T>(Load<float>(kHeaderSize + sizeof(T) + index * sizeof(float)));
+        }
+        return Load<T>(kHeaderSize + index * sizeof(T));
+    }
+    [[nodiscard]] unsigned int value(unsigned int index) const {
+        if (point_id_bits_ != 0) {
+            size_t bit = static_cast<size_t>(index) * point_id_bits_;
+            auto word = Load<uint64_t>(values_offset_ + bit / 8);
+            return static_cast<unsigned int>((word >> (bit % 8)) & ((uint64_t{1} << point_id_bits_) - 1));
+        }
+        return Load<unsigned int>(values_offset_ + index * sizeof(unsigned int));
+    }
+
+    // Index of the first key that is not less than key, or num_entries if there is none.
+    [[nodiscard]] unsigned int LowerBound(T key) const;
 
-    void Build(const std::vector<DotProductPointIdPair>& data);
+   private:
+    static constexpr size_t kHeaderSize = 3 * sizeof(unsigned int);
+
+    template <typename U>
+    [[nodiscard]] U Load(size_t offset) const {
+        U value;
+        std::memcpy(&value, page_ + offset, sizeof(U));
+        return value;
+    }
+
+    const char* page_{nullptr};
+    unsigned int point_id_bits_{0};
+    unsigned int num_entries_{0};
+    unsigned int prev_leaf_page_num_{0};
+    unsigned int next_leaf_page_num_{0};
+    T first_key_{0};
+    size_t values_offset_{0};
+};
+
+template <typename T>
+class BPlusTreeBulkLoader {
+   public:
+    // The tree is written to ofs from base_offset on, so that several trees can share one file, or to a string stream
+    // to build it in memory. Page numbers stored in the tree are relative to base_offset.
+    BPlusTreeBulkLoader(std::ostream& ofs, std::streamoff base_offset, unsigned int page_size,
+                        bool compressed_leaves = false);
+
+    void Build(const std::vector<DotProductPointIdPair<T>>& data);
+    // Builds the tree from a stream of num_entries pairs sorted by dot product, passed to Add one at a time. Only the
+    // leaf being filled and the first key of every leaf are kept in memory.
+    void Begin(size_t num_entries);
+    void Add(const DotProductPointIdPair<T>& pair);
+    void Finish();
+    [[nodiscard]] unsigned int num_pages() const { return num_page_; }
 
    private:
     unsigned int AllocatePage();
     void WritePage(unsigned int page_num);
+    void FlushPages();
+    void WriteLeaf();
 
-    std::ofstream ofs_;
+    std::ostream& ofs_;
+    std::streamoff base_offset_{0};
     unsigned int page_size_{0};
     unsigned int num_page_{0};
     unsigned int next_page_num_{0};
@@ -68,9 +186,22 @@ class BPlusTreeBulkLoader {
     unsigned int level_{0};
     unsigned int internal_node_order_{0};
     unsigned int leaf_node_order_{0};
+    bool compressed_leaves_{false};
+    unsigned int point_id_bits_{0};
+
+    // Streaming state
+    size_t num_entries_{0};
+    size_t num_added_{0};
+    LeafNode<T> leaf_node_{0};
+    std::vector<KeyPageNumPair<T>> parent_level_entries_;
 
     // utils
     std::vector<char> buffer_;
+    // Pages are written in the order they are allocated, except for the header page, so the allocated pages are kept in
+    // write_buffer_ and appended to the stream in large sequential writes. Only the header page is written again, at
+    // its offset, once the tree is built.
+    PageBuffer write_buffer_;
+    unsigned int num_flushed_pages_{0};
 };
 
 #endif
\ No newline at end of file
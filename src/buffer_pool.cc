@@ -0,0 +1,141 @@
+#include "buffer_pool.h"
+
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+BufferPool::BufferPool(unsigned int page_size, size_t num_frames)
+    : page_size_(page_size), num_frames_(std::max<size_t>(1, num_frames)) {}
+
+BufferPool::~BufferPool() {
+    for (int fd : file_descriptors_) {
+        close(fd);
+    }
+}
+
+unsigned int BufferPool::AddFile(const std::filesystem::path& file_path, bool direct_io) {
+    int fd = open(file_path.c_str(), direct_io ? O_RDONLY | O_DIRECT : O_RDONLY);
+    if (fd == -1) {
+        spdlog::error("Failed to open file: {}", file_path.string());
+    }
+    file_descriptors_.push_back(fd);
+    return static_cast<unsigned int>(file_descriptors_.size() - 1);
+}
+
+unsigned int BufferPool::AddRegion(unsigned int file_id, uint64_t offset) {
+    regions_.emplace_back(Region{.file_descriptor = file_descriptors_[file_id], .offset = offset});
+    return static_cast<unsigned int>(regions_.size() - 1);
+}
+
+void BufferPool::ReadPage(unsigned int region_id, unsigned int page_num, std::span<char> page) {
+    uint64_t key = GetKey(region_id, page_num);
+    {
+        std::scoped_lock lock(mutex_);
+        if (CopyCachedPage(key, page)) {
+            return;
+        }
+    }
+
+    const Region& region = regions_[region_id];
+    auto offset = static_cast<off_t>(region.offset + static_cast<uint64_t>(page_num) * page_size_);
+    if (pread(region.file_descriptor, page.data(), page_size_, offset) < 0) {
+        spdlog::error("Failed to read page {} of region {}", page_num, region_id);
+    }
+
+    std::scoped_lock lock(mutex_);
+    CachePage(key, page);
+}
+
+void BufferPool::ReadPages(std::span<const PageRequest> requests, IoRing& io_ring) {
+    std::vector<const PageRequest*> misses;
+    {
+        std::scoped_lock lock(mutex_);
+        for (const PageRequest& request : requests) {
+            if (!CopyCachedPage(GetKey(request.region_id, request.page_num), request.page)) {
+                misses.push_back(&request);
+            }
+        }
+    }
+    if (misses.empty()) {
+        return;
+    }
+
+    // All the misses are in flight together, outside of the lock.
+    for (const PageRequest* request : misses) {
+        const Region& region = regions_[request->region_id];
+        io_ring.AddRead(region.file_descriptor, request->page.data(), page_size_,
+                        region.offset + static_cast<uint64_t>(request->page_num) * page_size_);
+    }
+    io_ring.Wait();
+
+    std::scoped_lock lock(mutex_);
+    for (const PageRequest* request : misses) {
+        CachePage(GetKey(request->region_id, request->page_num), request->page);
+    }
+}
+
+void BufferPool::Prefetch(unsigned int region_id, unsigned int first_page_num, unsigned int num_pages) {
+    {
+        std::scoped_lock lock(mutex_);
+        bool cached = true;
+        for (unsigned int page_num = first_page_num; page_num < first_page_num + num_pages && cached; page_num++) {
+            cached = page_table_.contains(GetKey(region_id, page_num));
+        }
+        if (cached) {
+            return;
+        }
+    }
+
+    const Region& region = regions_[region_id];
+    posix_fadvise(region.file_descriptor,
+                  static_cast<off_t>(region.offset + static_cast<uint64_t>(first_page_num) * page_size_),
+                  static_cast<off_t>(static_cast<uint64_t>(num_pages) * page_size_), POSIX_FADV_WILLNEED);
+}
+
+uint64_t BufferPool::GetKey(unsigned int region_id, unsigned int page_num) {
+    return (static_cast<uint64_t>(region_id) << 32U) | page_num;  // NOLINT(readability-magic-numbers)
+}
+
+bool BufferPool::CopyCachedPage(uint64_t key, std::span<char> page) {
+    auto it = page_table_.find(key);
+    if (it == page_table_.end()) {
+        misses_++;
+        return false;
+    }
+    frames_[it->second].referenced = true;
+    std::memcpy(page.data(), data_.data() + it->second * page_size_, page_size_);
+    hits_++;
+    return true;
+}
+
+void BufferPool::CachePage(uint64_t key, std::span<const char> page) {
+    // Another thread may have loaded the same page while this one was reading it.
+    if (page_table_.contains(key)) {
+        return;
+    }
+    size_t frame = AllocateFrame();
+    frames_[frame] = Frame{.key = key, .referenced = true};
+    page_table_.emplace(key, frame);
+    std::memcpy(data_.data() + frame * page_size_, page.data(), page_size_);
+}
+
+size_t BufferPool::AllocateFrame() {
+    // Frames are only allocated when they are first needed, so a small index does not pay for the whole budget.
+    if (frames_.size() < num_frames_) {
+        frames_.emplace_back();
+        data_.resize(frames_.size() * page_size_);
+        return frames_.size() - 1;
+    }
+
+    while (frames_[clock_hand_].referenced) {
+        frames_[clock_hand_].referenced = false;
+        clock_hand_ = (clock_hand_ + 1) % num_frames_;
+    }
+    size_t frame = clock_hand_;
+    clock_hand_ = (clock_hand_ + 1) % num_frames_;
+    page_table_.erase(frames_[frame].key);
+    return frame;
+}
@@ -0,0 +1,104 @@
+#ifndef BUFFER_POOL_H_
+#define BUFFER_POOL_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <new>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "global.h"
+#include "io_ring.h"
+
+// Allocates storage aligned to Global::kDirectIoAlignment, which pages read from a file opened for direct I/O need.
+template <typename U>
+class PageAllocator {
+   public:
+    using value_type = U;
+
+    PageAllocator() = default;
+    template <typename V>
+    PageAllocator(const PageAllocator<V>& /*other*/) {}
+
+    U* allocate(size_t n) {
+        return static_cast<U*>(::operator new(n * sizeof(U), std::align_val_t{Global::kDirectIoAlignment}));
+    }
+    void deallocate(U* p, size_t /*n*/) { ::operator delete(p, std::align_val_t{Global::kDirectIoAlignment}); }
+
+    template <typename V>
+    bool operator==(const PageAllocator<V>& /*other*/) const {
+        return true;
+    }
+};
+
+using PageBuffer = std::vector<char, PageAllocator<char>>;
+
+// Fixed-size cache of the pages of several regions of files, shared by all threads. Pages are evicted with the CLOCK
+// algorithm: a hit sets the reference bit of its frame, and the clock hand gives every referenced frame a second chance
+// before it takes the first unreferenced one. Misses are read with pread, outside of the lock.
+class BufferPool {
+   public:
+    BufferPool(unsigned int page_size, size_t num_frames);
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Opens the file and returns its id. The pages of a file opened for direct I/O bypass the page cache, so they must
+    // be read into buffers aligned to Global::kDirectIoAlignment, such as the storage of a PageBuffer.
+    unsigned int AddFile(const std::filesystem::path& file_path, bool direct_io = false);
+    // Returns the id under which the pages of the file that start at the given byte offset are read. Page numbers are
+    // relative to that offset, and several regions may share a file.
+    unsigned int AddRegion(unsigned int file_id, uint64_t offset);
+    struct PageRequest {
+        unsigned int region_id{0};
+        unsigned int page_num{0};
+        std::span<char> page;
+    };
+
+    // Copies the page into the buffer, which must hold page_size bytes.
+    void ReadPage(unsigned int region_id, unsigned int page_num, std::span<char> page);
+    // Copies a batch of pages into their buffers. The pages that miss are all read at once through the ring.
+    void ReadPages(std::span<const PageRequest> requests, IoRing& io_ring);
+    // Asks the kernel to start reading num_pages pages from first_page_num on in the background, unless they are all
+    // cached already, so that reading them later does not block.
+    void Prefetch(unsigned int region_id, unsigned int first_page_num, unsigned int num_pages);
+
+    [[nodiscard]] size_t hits() const { return hits_; }
+    [[nodiscard]] size_t misses() const { return misses_; }
+
+   private:
+    struct Frame {
+        uint64_t key{0};
+        bool referenced{false};
+    };
+
+    struct Region {
+        int file_descriptor{-1};
+        uint64_t offset{0};
+    };
+
+    static uint64_t GetKey(unsigned int region_id, unsigned int page_num);
+    bool CopyCachedPage(uint64_t key, std::span<char> page);
+    void CachePage(uint64_t key, std::span<const char> page);
+    size_t AllocateFrame();
+
+    unsigned int page_size_;
+    size_t num_frames_;
+    std::vector<int> file_descriptors_;
+    std::vector<Region> regions_;
+
+    std::mutex mutex_;
+    std::vector<Frame> frames_;
+    std::vector<char> data_;
+    std::unordered_map<uint64_t, size_t> page_table_;
+    size_t clock_hand_{0};
+
+    std::atomic<size_t> hits_{0};
+    std::atomic<size_t> misses_{0};
+};
+
+#endif
@@ -3,31 +3,51 @@
 #include <spdlog/spdlog.h>
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <format>
+#include <fstream>
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <numeric>
 #include <random>
 #include <ratio>
+#include <span>
+#include <string>
+#include <thread>
 #include <utility>
+#include <vector>
 
 #include "b_plus_tree.h"
 #include "estimator.h"
+#include "external_sorter.h"
 #include "global.h"
+#include "mapped_point_set.h"
+#include "packed_index.h"
+#include "scalar_quantizer.h"
 #include "utils.h"
 
 // --------------------------------------------------
 // IndexCommand Implementation
 // --------------------------------------------------
 IndexCommand::IndexCommand(double norm_order, double approximation_ratio, unsigned int page_size,
-                           std::filesystem::path dataset_directory)
+                           std::filesystem::path dataset_directory, bool quantize, bool compress_leaves,
+                           bool pack, bool reorder, unsigned int num_threads, size_t memory_budget)
     : norm_order_(norm_order),
       approximation_ratio_(approximation_ratio),
       page_size_(page_size),
       dataset_directory_(std::move(dataset_directory)),
+      quantize_(quantize),
+      compress_leaves_(compress_leaves),
+      pack_(pack),
+      reorder_(reorder),
+      num_threads_(num_threads),
+      memory_budget_(memory_budget),
       gen_(Utils::CreateSeededGenerator()) {}
 
 void IndexCommand::Execute() {
@@ -38,17 +58,52 @@ void IndexCommand::Execute() {
     auto start = std::chrono::high_resolution_clock::now();
     double memory_before = Utils::GetMemoryUsage();
 
-    // Build index for point set B.
-    BuildIndex(PointSetMetadata{.file_path = dataset_directory_ / "B.bin",
-                                .num_points = dataset_metadata.num_points_b,
-                                .num_dimensions = dataset_metadata.num_dimensions},
-               dataset_directory_ / "index" / std::format("l{}", norm_order_) / "B");
+    Utils::VisitDataType(dataset_metadata.data_type, [&](auto type) {
+        using T = typename decltype(type)::type;
 
-    // Build index for point set A.
-    BuildIndex(PointSetMetadata{.file_path = dataset_directory_ / "A.bin",
-                                .num_points = dataset_metadata.num_points_a,
-                                .num_dimensions = dataset_metadata.num_dimensions},
-               dataset_directory_ / "index" / std::format("l{}", norm_order_) / "A");
+        // Point sets B and A, in this order.
+        std::array<PointSetMetadata, 2> point_sets{
+            PointSetMetadata{.data_type = dataset_metadata.data_type,
+                             .file_path = dataset_directory_ / "B.bin",
+                             .num_points = dataset_metadata.num_points_b,
+                             .num_dimensions = dataset_metadata.num_dimensions},
+            PointSetMetadata{.data_type = dataset_metadata.data_type,
+                             .file_path = dataset_directory_ / "A.bin",
+                             .num_points = dataset_metadata.num_points_a,
+                             .num_dimensions = dataset_metadata.num_dimensions}};
+        std::filesystem::path index_root = dataset_directory_ / "index" / std::format("l{}", norm_order_);
+        std::array<std::filesystem::path, 2> index_directories{index_root / "B", index_root / "A"};
+
+        // Draw all the dot vectors before any build starts, so that the indexes do not depend on how the builds are
+        // scheduled.
+        std::array<QalshConfig, 2> configs;
+        std::array<PointMatrix<T>, 2> dot_vectors;
+        for (unsigned int i = 0; i < 2; i++) {
+            configs[i] = CreateQalshConfig(point_sets[i]);
+            dot_vectors[i] = GenerateDotVectors<T>(configs[i].num_hash_tables, dataset_metadata.num_dimensions);
+        }
+
+        // Build the indexes of B and A concurrently, each with half of the threads and half of the memory budget.
+        std::array<unsigned int, 2> num_threads{std::max(1U, num_threads_ / 2),
+                                                std::max(1U, num_threads_ - num_threads_ / 2)};
+        size_t memory_budget = num_threads_ > 1 ? memory_budget_ / 2 : memory_budget_;
+
+        // Reordering the base points needs all the projections in memory. Check both point sets before any build
+        // starts, so that an impossible build does not leave a partial index behind.
+        for (unsigned int i = 0; i < 2; i++) {
+            size_t build_bytes = GetProjectionBytes<T>(point_sets[i], configs[i]);
+            if (reorder_ && memory_budget > 0 && build_bytes > memory_budget) {
+                spdlog::error("Reordering the base points needs all the projections in memory, which take {} bytes, "
+                              "more than the memory budget of {} bytes.",
+                              build_bytes, memory_budget);
+                return;
+            }
+        }
+        RunInParallel(2, num_threads_, [&](unsigned int i) {
+            BuildIndex<T>(point_sets[i], configs[i], dot_vectors[i], index_directories[i], num_threads[i],
+                          memory_budget);
+        });
+    });
 
     // End to record the time and memory.
     auto end = std::chrono::high_resolution_clock::now();
@@ -61,12 +116,69 @@ void IndexCommand::Execute() {
         std::chrono::duration<double, std::milli>(end - start).count(), memory_after - memory_before);
 }
 
-void IndexCommand::BuildIndex(const PointSetMetadata& point_set_metadata,
-                              const std::filesystem::path& index_directory) {
+void IndexCommand::RunInParallel(unsigned int num_tasks, unsigned int num_threads,
+                                 const std::function<void(unsigned int)>& task) {
+    std::atomic<unsigned int> next_task{0};
+    auto worker = [&]() {
+        for (unsigned int i = next_task++; i < num_tasks; i = next_task++) {
+            task(i);
+        }
+    };
+
+    std::vector<std::jthread> workers;
+    for (unsigned int i = 1; i < std::min(num_threads, num_tasks); i++) {
+        workers.emplace_back(worker);
+    }
+    worker();
+}
+
+QalshConfig IndexCommand::CreateQalshConfig(const PointSetMetadata& point_set_metadata) const {
     // Regularize the QALSH configuration
-    QalshConfig config{.approximation_ratio = approximation_ratio_, .page_size = page_size_};
+    QalshConfig config{.data_type = point_set_metadata.data_type,
+                       .approximation_ratio = approximation_ratio_,
+                       .page_size = page_size_,
+                       .quantized = quantize_,
+                       .compressed_leaves = compress_leaves_,
+                       .reordered = reorder_};
     Utils::RegularizeQalshConfig(config, point_set_metadata.num_points, norm_order_);
+    return config;
+}
+
+template <typename T>
+PointMatrix<T> IndexCommand::GenerateDotVectors(unsigned int num_hash_tables, unsigned int num_dimensions) {
+    spdlog::info("Generating dot vectors for {} hash tables...", num_hash_tables);
+    PointMatrix<T> dot_vectors(num_hash_tables, num_dimensions);
+    std::function<double()> generator;
 
+    if (std::abs(norm_order_ - 1.0) < Global::kEpsilon) {
+        std::cauchy_distribution<double> dist(0.0, 1.0);
+        generator = [dist, this]() mutable { return dist(gen_); };
+    }
+    // NOLINTNEXTLINE(readability-magic-numbers)
+    else if (std::abs(norm_order_ - 2.0) < Global::kEpsilon) {
+        std::normal_distribution<double> dist(0.0, 1.0);
+        generator = [dist, this]() mutable { return dist(gen_); };
+    } else {
+        spdlog::error("Unsupported norm order: {}", norm_order_);
+    }
+
+    // The dot vectors are the rows of the matrix, drawn one after the other.
+    std::ranges::generate_n(dot_vectors.data(), dot_vectors.size(), [&]() { return static_cast<T>(generator()); });
+    return dot_vectors;
+}
+
+template <typename T>
+size_t IndexCommand::GetProjectionBytes(const PointSetMetadata& point_set_metadata, const QalshConfig& config) {
+    bool encode_in_place = config.quantized && !config.reordered;
+    return static_cast<size_t>(point_set_metadata.num_points) *
+           (config.num_hash_tables * sizeof(DotProductPointIdPair<T>) +
+            (encode_in_place ? point_set_metadata.num_dimensions : 0));
+}
+
+template <typename T>
+void IndexCommand::BuildIndex(const PointSetMetadata& point_set_metadata, const QalshConfig& config,
+                              const PointMatrix<T>& dot_vectors, const std::filesystem::path& index_directory,
+                              unsigned int num_threads, size_t memory_budget) {
     // Print the QalshConfig parameters.
     spdlog::info(
         "QALSH Configuration:\n"
@@ -75,9 +187,12 @@ void IndexCommand::BuildIndex(const PointSetMetadata& point_set_metadata,
         "\tError Probability: {}\n"
         "\tNumber of Hash Tables: {}\n"
         "\tCollision Threshold: {}\n"
-        "\tPage Size: {}",
+        "\tPage Size: {}\n"
+        "\tQuantized: {}\n"
+        "\tCompressed Leaves: {}\n"
+        "\tReordered: {}",
         config.approximation_ratio, config.bucket_width, config.error_probability, config.num_hash_tables,
-        config.collision_threshold, config.page_size);
+        config.collision_threshold, config.page_size, config.quantized, config.compressed_leaves, config.reordered);
 
     // Create the index directory if it does not exist.
     if (!std::filesystem::exists(index_directory)) {
@@ -85,49 +200,49 @@ void IndexCommand::BuildIndex(const PointSetMetadata& point_set_metadata,
         std::filesystem::create_directories(index_directory);
     }
 
-    // Save the QALSH configuration.
-    spdlog::info("Saving QALSH configuration...");
-    Utils::SaveQalshConfig(config, index_directory / "config.json");
-
-    // Create the B+ tree directory.
+    // A packed index keeps the configuration, the dot vectors and the B+ trees in a single file, whose header is
+    // written last. Otherwise, each of them gets its own file, and a stale packed index must not shadow them.
+    PackedIndex::Directory directory{.config = config, .dot_vectors_offset = 0, .tree_offsets = {}};
     std::filesystem::path b_plus_tree_directory = index_directory / "b_plus_trees";
-    if (!std::filesystem::exists(b_plus_tree_directory)) {
-        spdlog::info("Creating B+ tree directory: {}", b_plus_tree_directory.string());
-        std::filesystem::create_directories(b_plus_tree_directory);
-    }
-
-    // Generate the dot vectors.
-    spdlog::info("Generating dot vectors for {} hash tables...", config.num_hash_tables);
-    std::vector<std::vector<double>> dot_vectors(config.num_hash_tables);
-    std::function<double()> generator;
-
-    if (std::abs(norm_order_ - 1.0) < Global::kEpsilon) {
-        std::cauchy_distribution<double> dist(0.0, 1.0);
-        generator = [dist, this]() mutable { return dist(gen_); };
-    }
-    // NOLINTNEXTLINE(readability-magic-numbers)
-    else if (std::abs(norm_order_ - 2.0) < Global::kEpsilon) {
-        std::normal_distribution<double> dist(0.0, 1.0);
-        generator = [dist, this]() mutable { return dist(gen_); };
+    std::ofstream index_file;
+    if (pack_) {
+        index_file.open(index_directory / PackedIndex::kFileName, std::ios::binary | std::ios::trunc);
+        if (!index_file.is_open()) {
+            spdlog::error("Failed to open file for writing: {}", (index_directory / PackedIndex::kFileName).string());
+        }
+        directory.dot_vectors_offset = PackedIndex::AlignToPage(
+            PackedIndex::GetHeaderSize(Utils::SerializeQalshConfig(config), config.num_hash_tables), config.page_size);
     } else {
-        spdlog::error("Unsupported norm order: {}", norm_order_);
-    }
+        std::filesystem::remove(index_directory / PackedIndex::kFileName);
 
-    for (unsigned int i = 0; i < config.num_hash_tables; i++) {
-        dot_vectors[i].reserve(point_set_metadata.num_dimensions);
-        std::ranges::generate_n(std::back_inserter(dot_vectors[i]), point_set_metadata.num_dimensions, generator);
+        // Save the QALSH configuration.
+        spdlog::info("Saving QALSH configuration...");
+        Utils::SaveQalshConfig(config, index_directory / "config.json");
+
+        // Create the B+ tree directory.
+        if (!std::filesystem::exists(b_plus_tree_directory)) {
+            spdlog::info("Creating B+ tree directory: {}", b_plus_tree_directory.string());
+            std::filesystem::create_directories(b_plus_tree_directory);
+        }
     }
 
     // Save the dot product vectors
     spdlog::info("Saving dot product vectors...");
-    std::ofstream ofs(index_directory / "dot_vectors.bin", std::ios::binary);
-    if (!ofs.is_open()) {
-        spdlog::error(
-            std::format("Failed to open file for writing: {}", (index_directory / "dot_vectors.bin").string()));
+    std::ofstream dot_vector_file;
+    std::ofstream& ofs = pack_ ? index_file : dot_vector_file;
+    if (pack_) {
+        ofs.seekp(static_cast<std::streamoff>(directory.dot_vectors_offset), std::ios::beg);
+    } else {
+        dot_vector_file.open(index_directory / "dot_vectors.bin", std::ios::binary);
+        if (!dot_vector_file.is_open()) {
+            spdlog::error(
+                std::format("Failed to open file for writing: {}", (index_directory / "dot_vectors.bin").string()));
+        }
     }
-    for (unsigned int i = 0; i < config.num_hash_tables; i++) {
-        ofs.write(reinterpret_cast<const char*>(dot_vectors[i].data()),
-                  static_cast<std::streamsize>(dot_vectors[i].size() * sizeof(Coordinate)));
+    ofs.write(reinterpret_cast<const char*>(dot_vectors.data()),
+              static_cast<std::streamsize>(dot_vectors.size() * sizeof(T)));
+    if (!ofs) {
+        spdlog::error("Failed to write the dot product vectors to {}", index_directory.string());
     }
 
     // Open the point set file
@@ -137,23 +252,263 @@ void IndexCommand::BuildIndex(const PointSetMetadata& point_set_metadata,
         return;
     }
 
-    // Build the B+ trees for each hash table.
-    spdlog::info("Building B+ trees for each hash table...");
-    std::vector<std::vector<DotProductPointIdPair>> data(config.num_hash_tables);
-    for (unsigned int i = 0; i < point_set_metadata.num_points; i++) {
-        Point point = Utils::ReadPoint(base_file, point_set_metadata.num_dimensions, i);
-        for (unsigned int j = 0; j < config.num_hash_tables; j++) {
-            double dot_product = Utils::DotProduct(point, dot_vectors[j]);
-            data[j].emplace_back(DotProductPointIdPair{.dot_product = dot_product, .point_id = i});
+    // Train the scalar quantizer and open the file of quantized codes.
+    ScalarQuantizer quantizer;
+    std::ofstream codes_file;
+    if (config.quantized) {
+        spdlog::info("Training the scalar quantizer...");
+        quantizer.Train<T>(base_file, point_set_metadata.num_points, point_set_metadata.num_dimensions);
+        quantizer.Save(index_directory / "quantizer.bin");
+        codes_file.open(index_directory / "codes.bin", std::ios::binary);
+        if (!codes_file.is_open()) {
+            spdlog::error("Failed to open file for writing: {}", (index_directory / "codes.bin").string());
+        }
+    }
+
+    MappedPointSet<T> base_points;
+    base_points.Open(point_set_metadata, AccessPattern::kSequential);
+    unsigned int num_points = point_set_metadata.num_points;
+    unsigned int num_dimensions = point_set_metadata.num_dimensions;
+    bool encode_in_place = config.quantized && !config.reordered;
+
+    // Projects the points [first, first + count) on the dot vectors into tables, and encodes them into codes, block by
+    // block. Each block fills its own slots, so the result does not depend on the number of threads.
+    auto project = [&](unsigned int first, unsigned int count,
+                       std::vector<std::vector<DotProductPointIdPair<T>>>& tables, std::span<uint8_t> codes) {
+        unsigned int num_blocks = (count + Global::kQueryBlockSize - 1) / Global::kQueryBlockSize;
+        RunInParallel(num_blocks, num_threads, [&](unsigned int block) {
+            unsigned int block_first = block * Global::kQueryBlockSize;
+            unsigned int block_size = std::min(Global::kQueryBlockSize, count - block_first);
+
+            // Project the whole block against every dot vector with a single matrix-matrix product. The product is
+            // column-major, so the keys of every table are contiguous.
+            Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> keys =
+                base_points.GetPoints(first + block_first, block_size) * dot_vectors.transpose();
+            for (unsigned int j = 0; j < config.num_hash_tables; j++) {
+                for (unsigned int i = 0; i < block_size; i++) {
+                    tables[j][block_first + i] =
+                        DotProductPointIdPair<T>{.dot_product = keys(i, j), .point_id = first + block_first + i};
+                }
+            }
+
+            if (encode_in_place) {
+                for (unsigned int i = block_first; i < block_first + block_size; i++) {
+                    quantizer.Encode<T>(base_points.GetPoint(first + i),
+                                        codes.subspan(static_cast<size_t>(i) * num_dimensions, num_dimensions));
+                }
+            }
+        });
+    };
+
+    // Bulk loads the B+ tree of hash table i with load. The trees of a packed index go to temporary files, which are
+    // appended to the index in table order once all of them are built, since the offset of a tree depends on the sizes
+    // of the trees before it. They are not kept in memory, which the memory budget leaves to the projections.
+    std::filesystem::path run_directory = index_directory / "runs";
+    std::vector<std::unique_ptr<std::fstream>> packed_trees(pack_ ? config.num_hash_tables : 0);
+    if (pack_) {
+        std::filesystem::create_directories(run_directory);
+    }
+    std::vector<unsigned int> tree_num_pages(config.num_hash_tables);
+    std::vector<double> tree_load_times(config.num_hash_tables);
+    auto build_tree = [&](unsigned int i, const std::function<void(BPlusTreeBulkLoader<T>&)>& load) {
+        std::ofstream tree_file;
+        std::ostream* tree_stream = &tree_file;
+        if (pack_) {
+            std::filesystem::path tree_path = run_directory / std::format("tree_{}.bin", i);
+            packed_trees[i] = std::make_unique<std::fstream>(
+                tree_path, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+            if (!packed_trees[i]->is_open()) {
+                spdlog::error("Failed to open file: {}", tree_path.string());
+            }
+            tree_stream = packed_trees[i].get();
+        } else {
+            std::filesystem::path tree_path = b_plus_tree_directory / std::format("{}.bin", i);
+            tree_file.open(tree_path, std::ios::binary | std::ios::trunc);
+            if (!tree_file.is_open()) {
+                spdlog::error("Failed to open file: {}", tree_path.string());
+            }
+        }
+
+        BPlusTreeBulkLoader<T> bulk_loader(*tree_stream, 0, config.page_size, config.compressed_leaves);
+        auto start = std::chrono::high_resolution_clock::now();
+        load(bulk_loader);
+        if (!*tree_stream) {
+            spdlog::error("Failed to write the B+ tree of hash table {}", i);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        tree_num_pages[i] = bulk_loader.num_pages();
+        tree_load_times[i] = std::chrono::duration<double>(end - start).count();
+    };
+
+    // When the projections do not fit in the memory budget, they are sorted out of core instead. Execute has checked
+    // that the index is not reordered then.
+    size_t build_bytes = GetProjectionBytes<T>(point_set_metadata, config);
+    bool out_of_core = memory_budget > 0 && build_bytes > memory_budget;
+
+    if (out_of_core) {
+        spdlog::info("The projections take {} bytes, more than the memory budget of {} bytes. Sorting them out of "
+                     "core in {}...",
+                     build_bytes, memory_budget, run_directory.string());
+        std::filesystem::create_directories(run_directory);
+
+        // Every table gets a sorter, and the sorters that merge at the same time share the budget.
+        std::vector<std::unique_ptr<ExternalSorter<T>>> sorters;
+        size_t sorter_budget = memory_budget / std::max(1U, std::min(num_threads, config.num_hash_tables));
+        for (unsigned int i = 0; i < config.num_hash_tables; i++) {
+            sorters.push_back(
+                std::make_unique<ExternalSorter<T>>(run_directory / std::format("{}.bin", i), sorter_budget));
+        }
+
+        // Project the points in runs that take up to the whole budget, and spill every run of every table sorted. A run
+        // is made of at least one whole block of points, so that the points are projected in the same blocks as in
+        // memory, and get the same keys.
+        size_t num_budget_blocks = memory_budget / (build_bytes / num_points) / Global::kQueryBlockSize;
+        auto run_size = static_cast<unsigned int>(std::max<size_t>(1, num_budget_blocks) * Global::kQueryBlockSize);
+        spdlog::info("Projecting the points on the dot vectors in runs of {} points...", run_size);
+        std::vector<std::vector<DotProductPointIdPair<T>>> runs(config.num_hash_tables);
+        std::vector<uint8_t> codes(encode_in_place ? static_cast<size_t>(run_size) * num_dimensions : 0);
+        for (unsigned int first = 0; first < num_points; first += run_size) {
+            unsigned int count = std::min(run_size, num_points - first);
+            for (auto& run : runs) {
+                run.resize(count);
+            }
+            project(first, count, runs, codes);
+            if (encode_in_place) {
+                codes_file.write(reinterpret_cast<const char*>(codes.data()),
+                                 static_cast<std::streamsize>(static_cast<size_t>(count) * num_dimensions));
+            }
+            RunInParallel(config.num_hash_tables, num_threads, [&](unsigned int i) { sorters[i]->AddRun(runs[i]); });
+        }
+        runs = {};
+        codes = {};
+
+        // Merge the runs of every table straight into its B+ tree, and drop the runs once the tree is built.
+        spdlog::info("Building B+ trees for each hash table...");
+        RunInParallel(config.num_hash_tables, num_threads, [&](unsigned int i) {
+            build_tree(i, [&](BPlusTreeBulkLoader<T>& bulk_loader) {
+                bulk_loader.Begin(num_points);
+                sorters[i]->Merge([&](const DotProductPointIdPair<T>& pair) { bulk_loader.Add(pair); });
+                bulk_loader.Finish();
+            });
+            sorters[i].reset();
+        });
+    } else {
+        // Project all the points at once.
+        spdlog::info("Projecting the points on the dot vectors...");
+        std::vector<std::vector<DotProductPointIdPair<T>>> data(config.num_hash_tables,
+                                                                std::vector<DotProductPointIdPair<T>>(num_points));
+        std::vector<uint8_t> codes(encode_in_place ? static_cast<size_t>(num_points) * num_dimensions : 0);
+        project(0, num_points, data, codes);
+        if (encode_in_place) {
+            codes_file.write(reinterpret_cast<const char*>(codes.data()), static_cast<std::streamsize>(codes.size()));
+        }
+
+        // Store a copy of the base points sorted by their projection on the first dot vector, and let the trees refer
+        // to the points by their position in that copy. The candidates of a query collide in a narrow window of every
+        // projection, so they end up close to each other in the copy, and verifying them reads neighbouring pages.
+        if (config.reordered) {
+            spdlog::info("Reordering the base points...");
+            std::ranges::sort(data[0], CompareDotProductPointIdPair{});
+            std::vector<unsigned int> point_ids(num_points);
+            std::vector<unsigned int> new_point_ids(num_points);
+            for (unsigned int i = 0; i < num_points; i++) {
+                point_ids[i] = data[0][i].point_id;
+                new_point_ids[point_ids[i]] = i;
+            }
+            for (auto& table : data) {
+                for (auto& pair : table) {
+                    pair.point_id = new_point_ids[pair.point_id];
+                }
+            }
+
+            std::ofstream point_ids_file(index_directory / "point_ids.bin", std::ios::binary);
+            std::ofstream points_file(index_directory / "points.bin", std::ios::binary);
+            if (!point_ids_file.is_open() || !points_file.is_open()) {
+                spdlog::error("Failed to open file for writing: {}", index_directory.string());
+            }
+            point_ids_file.write(reinterpret_cast<const char*>(point_ids.data()),
+                                 static_cast<std::streamsize>(point_ids.size() * sizeof(unsigned int)));
+            std::vector<uint8_t> code(num_dimensions);
+            for (unsigned int point_id : point_ids) {
+                PointView<T> point = base_points.GetPoint(point_id);
+                points_file.write(reinterpret_cast<const char*>(point.data()),
+                                  static_cast<std::streamsize>(point.size() * sizeof(T)));
+                if (config.quantized) {
+                    quantizer.Encode<T>(point, code);
+                    codes_file.write(reinterpret_cast<const char*>(code.data()),
+                                     static_cast<std::streamsize>(code.size()));
+                }
+            }
+        }
+
+        // Sort the dot products and bulk load the B+ tree of every hash table as a task of its own, releasing the
+        // table once its tree is built.
+        spdlog::info("Building B+ trees for each hash table...");
+        RunInParallel(config.num_hash_tables, num_threads, [&](unsigned int i) {
+            std::ranges::sort(data[i], CompareDotProductPointIdPair{});
+            build_tree(i, [&](BPlusTreeBulkLoader<T>& bulk_loader) { bulk_loader.Build(data[i]); });
+            std::vector<DotProductPointIdPair<T>>().swap(data[i]);
+        });
+    }
+
+    // Report the throughput of the bulk loads alone, with the times of all the trees summed whatever the number of
+    // threads. Out of core, the loads include merging the runs.
+    uint64_t num_pages = std::accumulate(tree_num_pages.begin(), tree_num_pages.end(), uint64_t{0});
+    double load_time = std::accumulate(tree_load_times.begin(), tree_load_times.end(), 0.0);
+    constexpr double kBytesPerMegabyte = 1 << 20;
+    double num_megabytes = static_cast<double>(num_pages * config.page_size) / kBytesPerMegabyte;
+    // Small trees may load within the resolution of the clock, which leaves no rate to report.
+    if (load_time > 0.0) {
+        spdlog::info("Bulk loaded {} pages ({:.1f} MB) in {:.3f} s: {:.0f} pages/s, {:.1f} MB/s", num_pages,
+                     num_megabytes, load_time, static_cast<double>(num_pages) / load_time, num_megabytes / load_time);
+    } else {
+        spdlog::info("Bulk loaded {} pages ({:.1f} MB) in {:.3f} s", num_pages, num_megabytes, load_time);
+    }
+
+    if (pack_) {
+        uint64_t tree_offset = PackedIndex::AlignToPage(
+            directory.dot_vectors_offset +
+                static_cast<uint64_t>(config.num_hash_tables) * num_dimensions * sizeof(T),
+            config.page_size);
+        for (unsigned int i = 0; i < config.num_hash_tables; i++) {
+            directory.tree_offsets.push_back(tree_offset);
+            index_file.seekp(static_cast<std::streamoff>(tree_offset), std::ios::beg);
+            packed_trees[i]->seekg(0, std::ios::beg);
+            if (!*packed_trees[i]) {
+                spdlog::error("Failed to read back the B+ tree of hash table {}", i);
+            }
+            index_file << packed_trees[i]->rdbuf();
+            packed_trees[i].reset();
+            tree_offset += static_cast<uint64_t>(tree_num_pages[i]) * config.page_size;
+
+            // The copy stops early, without failing the index stream, if the tree cannot be read to its end.
+            if (!index_file || static_cast<uint64_t>(index_file.tellp()) != tree_offset) {
+                spdlog::error("Failed to copy the B+ tree of hash table {} to {}", i,
+                              (index_directory / PackedIndex::kFileName).string());
+            }
+        }
+    }
+    std::filesystem::remove_all(run_directory);
+
+    // Write the header of the packed index.
+    if (pack_) {
+        spdlog::info("Writing the packed index header...");
+        PackedIndex::WriteHeader(index_file, directory);
+        index_file.close();
+        if (!index_file) {
+            spdlog::error("Failed to write {}", (index_directory / PackedIndex::kFileName).string());
         }
     }
-    for (unsigned int i = 0; i < config.num_hash_tables; i++) {
-        // Sort the dot products.
-        std::ranges::sort(data[i], {}, &DotProductPointIdPair::dot_product);
 
-        // Bulk load the B+ tree.
-        BPlusTreeBulkLoader bulk_loader(b_plus_tree_directory / std::format("{}.bin", i), config.page_size);
-        bulk_loader.Build(data[i]);
+    // Direct I/O reads whole pages at page offsets, so they must be aligned for the device that holds the index.
+    unsigned int alignment = Utils::GetDirectIoAlignment(pack_ ? index_directory / PackedIndex::kFileName
+                                                               : b_plus_tree_directory / "0.bin");
+    if (alignment == 0) {
+        spdlog::warn("The file system of {} does not support direct I/O.", index_directory.string());
+    } else if (config.page_size % alignment != 0 || alignment > Global::kDirectIoAlignment) {
+        spdlog::warn("The page size {} does not fit the direct I/O alignment of {} bytes, so the index cannot be "
+                     "searched with direct I/O.",
+                     config.page_size, alignment);
     }
 }
 
@@ -174,27 +529,23 @@ void EstimateCommand::Execute() {
 
     // Construct point set metadata
     PointSetMetadata point_set_metadata_a = {
+        .data_type = dataset_metadata.data_type,
         .file_path = dataset_directory_ / "A.bin",
         .num_points = dataset_metadata.num_points_a,
         .num_dimensions = dataset_metadata.num_dimensions,
     };
     PointSetMetadata point_set_metadata_b = {
+        .data_type = dataset_metadata.data_type,
         .file_path = dataset_directory_ / "B.bin",
         .num_points = dataset_metadata.num_points_b,
         .num_dimensions = dataset_metadata.num_dimensions,
     };
 
-    // Calculate the distance from A to B
+    // Calculate the distances from A to B and from B to A
     auto start = std::chrono::high_resolution_clock::now();
     double memory_before = Utils::GetMemoryUsage();
-    spdlog::info("Calculating the distance from A to B...");
-    double distance_ab =
-        estimator_->EstimateDistance(point_set_metadata_a, point_set_metadata_b, norm_order_, in_memory_);
-
-    // Calculate the distance from B to A
-    spdlog::info("Calculating the distance from B to A...");
-    double distance_ba =
-        estimator_->EstimateDistance(point_set_metadata_b, point_set_metadata_a, norm_order_, in_memory_);
+    auto [distance_ab, distance_ba] =
+        estimator_->EstimateDistances(point_set_metadata_a, point_set_metadata_b, norm_order_, in_memory_);
     auto end = std::chrono::high_resolution_clock::now();
     double memory_after = Utils::GetMemoryUsage();
 
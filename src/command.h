@@ -1,11 +1,15 @@
 #ifndef COMMAND_H_
 #define COMMAND_H_
 
+#include <cstddef>
 #include <filesystem>
+#include <functional>
 #include <memory>
 #include <random>
+#include <vector>
 
 #include "estimator.h"
+#include "types.h"
 
 class Command {
    public:
@@ -16,16 +20,37 @@ class Command {
 class IndexCommand : public Command {
    public:
     IndexCommand(double norm_order, double approximation_ratio, unsigned int page_size,
-                 std::filesystem::path dataset_directory);
+                 std::filesystem::path dataset_directory, bool quantize, bool compress_leaves,
+                 bool pack, bool reorder, unsigned int num_threads, size_t memory_budget);
     void Execute() override;
 
    private:
-    void BuildIndex(const PointSetMetadata& point_set_metadata, const std::filesystem::path& index_directory);
+    // Runs task(0), ..., task(num_tasks - 1) on up to num_threads threads, including the calling one.
+    static void RunInParallel(unsigned int num_tasks, unsigned int num_threads,
+                              const std::function<void(unsigned int)>& task);
+
+    [[nodiscard]] QalshConfig CreateQalshConfig(const PointSetMetadata& point_set_metadata) const;
+    template <typename T>
+    PointMatrix<T> GenerateDotVectors(unsigned int num_hash_tables, unsigned int num_dimensions);
+    // Returns the bytes that the projections of all the hash tables, and the codes encoded along with them, take.
+    template <typename T>
+    static size_t GetProjectionBytes(const PointSetMetadata& point_set_metadata, const QalshConfig& config);
+    template <typename T>
+    void BuildIndex(const PointSetMetadata& point_set_metadata, const QalshConfig& config,
+                    const PointMatrix<T>& dot_vectors, const std::filesystem::path& index_directory,
+                    unsigned int num_threads, size_t memory_budget);
 
     double norm_order_;
     double approximation_ratio_;
     unsigned int page_size_;
     std::filesystem::path dataset_directory_;
+    bool quantize_;
+    bool compress_leaves_;
+    bool pack_;
+    bool reorder_;
+    unsigned int num_threads_;
+    // Bytes that building an index may take, or 0 for no bound.
+    size_t memory_budget_;
     std::mt19937 gen_;
 };
 
@@ -0,0 +1,389 @@
+#include "distance.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "global.h"
+
+template <typename T>
+DistanceFunction<T> Distance<T>::Get(double norm_order) {
+    if (std::abs(norm_order - 1.0) < Global::kEpsilon) {
+        return GetKernels().l1;
+    }
+    // NOLINTNEXTLINE(readability-magic-numbers)
+    if (std::abs(norm_order - 2.0) < Global::kEpsilon) {
+        return GetKernels().l2;
+    }
+    spdlog::error("Unsupported norm order: {}", norm_order);
+    return nullptr;
+}
+
+template <typename T>
+double Distance<T>::L1(PointView<T> pt1, PointView<T> pt2, double bound) {
+    return GetKernels().l1(pt1, pt2, bound);
+}
+
+template <typename T>
+double Distance<T>::L2(PointView<T> pt1, PointView<T> pt2, double bound) {
+    return GetKernels().l2(pt1, pt2, bound);
+}
+
+template <typename T>
+const typename Distance<T>::Kernels& Distance<T>::GetKernels() {
+    static const Kernels kernels = []() {
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            spdlog::debug("Using AVX-512 distance kernels.");
+            return Kernels{.l1 = &L1Avx512, .l2 = &L2Avx512};
+        }
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            spdlog::debug("Using AVX2 distance kernels.");
+            return Kernels{.l1 = &L1Avx2, .l2 = &L2Avx2};
+        }
+#endif
+        spdlog::debug("Using scalar distance kernels.");
+        return Kernels{.l1 = &L1Scalar, .l2 = &L2Scalar};
+    }();
+    return kernels;
+}
+
+// ---------- Scalar Kernels ----------
+template <typename T>
+double Distance<T>::L1Scalar(PointView<T> pt1, PointView<T> pt2, double bound) {
+    const size_t num_dimensions = pt1.size();
+    T sum = 0;
+
+    size_t i = 0;
+    while (i < num_dimensions) {
+        size_t block_end = std::min(i + Global::kDistanceBlockSize, num_dimensions);
+        for (; i < block_end; i++) {
+            sum += std::abs(pt1[i] - pt2[i]);
+        }
+        if (static_cast<double>(sum) > bound) {
+            break;
+        }
+    }
+    return sum;
+}
+
+template <typename T>
+double Distance<T>::L2Scalar(PointView<T> pt1, PointView<T> pt2, double bound) {
+    const size_t num_dimensions = pt1.size();
+    const double squared_bound = bound * bound;
+    T sum = 0;
+
+    size_t i = 0;
+    while (i < num_dimensions) {
+        size_t block_end = std::min(i + Global::kDistanceBlockSize, num_dimensions);
+        for (; i < block_end; i++) {
+            T diff = pt1[i] - pt2[i];
+            sum += diff * diff;
+        }
+        if (static_cast<double>(sum) > squared_bound) {
+            break;
+        }
+    }
+    return std::sqrt(static_cast<double>(sum));
+}
+
+#if defined(__x86_64__)
+// ---------- AVX2 Kernels (float64) ----------
+// Both kernels accumulate whole blocks of Global::kDistanceBlockSize coordinates in vector registers and only reduce
+// them to compare against the bound at the end of every block.
+__attribute__((target("avx2,fma"))) static double HorizontalSum(__m256d v) {
+    __m128d low = _mm256_castpd256_pd128(v);
+    __m128d high = _mm256_extractf128_pd(v, 1);
+    low = _mm_add_pd(low, high);
+    high = _mm_unpackhi_pd(low, low);
+    return _mm_cvtsd_f64(_mm_add_sd(low, high));
+}
+
+template <>
+__attribute__((target("avx2,fma"))) double Distance<double>::L1Avx2(PointView<double> pt1, PointView<double> pt2,
+                                                                 double bound) {
+    constexpr size_t kWidth = 4;
+    const size_t num_dimensions = pt1.size();
+    const double* a = pt1.data();
+    const double* b = pt2.data();
+    const __m256d sign_mask = _mm256_set1_pd(-0.0);
+    __m256d acc0 = _mm256_setzero_pd();
+    __m256d acc1 = _mm256_setzero_pd();
+
+    size_t i = 0;
+    for (; i + Global::kDistanceBlockSize <= num_dimensions;) {
+        for (size_t block_end = i + Global::kDistanceBlockSize; i < block_end; i += 2 * kWidth) {
+            __m256d diff0 = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+            __m256d diff1 = _mm256_sub_pd(_mm256_loadu_pd(a + i + kWidth), _mm256_loadu_pd(b + i + kWidth));
+            acc0 = _mm256_add_pd(acc0, _mm256_andnot_pd(sign_mask, diff0));
+            acc1 = _mm256_add_pd(acc1, _mm256_andnot_pd(sign_mask, diff1));
+        }
+        if (double sum = HorizontalSum(_mm256_add_pd(acc0, acc1)); sum > bound) {
+            return sum;
+        }
+    }
+    for (; i + kWidth <= num_dimensions; i += kWidth) {
+        __m256d diff = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+        acc0 = _mm256_add_pd(acc0, _mm256_andnot_pd(sign_mask, diff));
+    }
+
+    double sum = HorizontalSum(_mm256_add_pd(acc0, acc1));
+    for (; i < num_dimensions; i++) {
+        sum += std::abs(a[i] - b[i]);
+    }
+    return sum;
+}
+
+template <>
+__attribute__((target("avx2,fma"))) double Distance<double>::L2Avx2(PointView<double> pt1, PointView<double> pt2,
+                                                                 double bound) {
+    constexpr size_t kWidth = 4;
+    const size_t num_dimensions = pt1.size();
+    const double* a = pt1.data();
+    const double* b = pt2.data();
+    const double squared_bound = bound * bound;
+    __m256d acc0 = _mm256_setzero_pd();
+    __m256d acc1 = _mm256_setzero_pd();
+
+    size_t i = 0;
+    for (; i + Global::kDistanceBlockSize <= num_dimensions;) {
+        for (size_t block_end = i + Global::kDistanceBlockSize; i < block_end; i += 2 * kWidth) {
+            __m256d diff0 = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+            __m256d diff1 = _mm256_sub_pd(_mm256_loadu_pd(a + i + kWidth), _mm256_loadu_pd(b + i + kWidth));
+            acc0 = _mm256_fmadd_pd(diff0, diff0, acc0);
+            acc1 = _mm256_fmadd_pd(diff1, diff1, acc1);
+        }
+        if (double sum = HorizontalSum(_mm256_add_pd(acc0, acc1)); sum > squared_bound) {
+            return std::sqrt(sum);
+        }
+    }
+    for (; i + kWidth <= num_dimensions; i += kWidth) {
+        __m256d diff = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+        acc0 = _mm256_fmadd_pd(diff, diff, acc0);
+    }
+
+    double sum = HorizontalSum(_mm256_add_pd(acc0, acc1));
+    for (; i < num_dimensions; i++) {
+        double diff = a[i] - b[i];
+        sum += diff * diff;
+    }
+    return std::sqrt(sum);
+}
+
+// ---------- AVX-512 Kernels (float64) ----------
+// Same blocking as the AVX2 kernels; the tail is handled with a masked load instead of a scalar loop.
+template <>
+__attribute__((target("avx512f"))) double Distance<double>::L1Avx512(PointView<double> pt1,
+                                                                  PointView<double> pt2, double bound) {
+    constexpr size_t kWidth = 8;
+    const size_t num_dimensions = pt1.size();
+    const double* a = pt1.data();
+    const double* b = pt2.data();
+    __m512d acc0 = _mm512_setzero_pd();
+    __m512d acc1 = _mm512_setzero_pd();
+
+    size_t i = 0;
+    for (; i + Global::kDistanceBlockSize <= num_dimensions;) {
+        for (size_t block_end = i + Global::kDistanceBlockSize; i < block_end; i += 2 * kWidth) {
+            __m512d diff0 = _mm512_sub_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i));
+            __m512d diff1 = _mm512_sub_pd(_mm512_loadu_pd(a + i + kWidth), _mm512_loadu_pd(b + i + kWidth));
+            acc0 = _mm512_add_pd(acc0, _mm512_abs_pd(diff0));
+            acc1 = _mm512_add_pd(acc1, _mm512_abs_pd(diff1));
+        }
+        if (double sum = _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1)); sum > bound) {
+            return sum;
+        }
+    }
+    for (; i < num_dimensions; i += kWidth) {
+        auto mask = static_cast<__mmask8>((1U << std::min(num_dimensions - i, kWidth)) - 1);
+        __m512d diff = _mm512_sub_pd(_mm512_maskz_loadu_pd(mask, a + i), _mm512_maskz_loadu_pd(mask, b + i));
+        acc0 = _mm512_add_pd(acc0, _mm512_abs_pd(diff));
+    }
+    return _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1));
+}
+
+template <>
+__attribute__((target("avx512f"))) double Distance<double>::L2Avx512(PointView<double> pt1,
+                                                                  PointView<double> pt2, double bound) {
+    constexpr size_t kWidth = 8;
+    const size_t num_dimensions = pt1.size();
+    const double* a = pt1.data();
+    const double* b = pt2.data();
+    const double squared_bound = bound * bound;
+    __m512d acc0 = _mm512_setzero_pd();
+    __m512d acc1 = _mm512_setzero_pd();
+
+    size_t i = 0;
+    for (; i + Global::kDistanceBlockSize <= num_dimensions;) {
+        for (size_t block_end = i + Global::kDistanceBlockSize; i < block_end; i += 2 * kWidth) {
+            __m512d diff0 = _mm512_sub_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i));
+            __m512d diff1 = _mm512_sub_pd(_mm512_loadu_pd(a + i + kWidth), _mm512_loadu_pd(b + i + kWidth));
+            acc0 = _mm512_fmadd_pd(diff0, diff0, acc0);
+            acc1 = _mm512_fmadd_pd(diff1, diff1, acc1);
+        }
+        if (double sum = _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1)); sum > squared_bound) {
+            return std::sqrt(sum);
+        }
+    }
+    for (; i < num_dimensions; i += kWidth) {
+        auto mask = static_cast<__mmask8>((1U << std::min(num_dimensions - i, kWidth)) - 1);
+        __m512d diff = _mm512_sub_pd(_mm512_maskz_loadu_pd(mask, a + i), _mm512_maskz_loadu_pd(mask, b + i));
+        acc0 = _mm512_fmadd_pd(diff, diff, acc0);
+    }
+    return std::sqrt(_mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1)));
+}
+
+// ---------- AVX2 Kernels (float32) ----------
+__attribute__((target("avx2,fma"))) static float HorizontalSum(__m256 v) {
+    __m128 low = _mm256_castps256_ps128(v);
+    __m128 high = _mm256_extractf128_ps(v, 1);
+    low = _mm_add_ps(low, high);
+    high = _mm_movehl_ps(high, low);
+    low = _mm_add_ps(low, high);
+    high = _mm_shuffle_ps(low, low, 1);
+    return _mm_cvtss_f32(_mm_add_ss(low, high));
+}
+
+template <>
+__attribute__((target("avx2,fma"))) double Distance<float>::L1Avx2(PointView<float> pt1, PointView<float> pt2,
+                                                                double bound) {
+    constexpr size_t kWidth = 8;
+    const size_t num_dimensions = pt1.size();
+    const float* a = pt1.data();
+    const float* b = pt2.data();
+    const __m256 sign_mask = _mm256_set1_ps(-0.0F);
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+
+    size_t i = 0;
+    for (; i + Global::kDistanceBlockSize <= num_dimensions;) {
+        for (size_t block_end = i + Global::kDistanceBlockSize; i < block_end; i += 2 * kWidth) {
+            __m256 diff0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+            __m256 diff1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + kWidth), _mm256_loadu_ps(b + i + kWidth));
+            acc0 = _mm256_add_ps(acc0, _mm256_andnot_ps(sign_mask, diff0));
+            acc1 = _mm256_add_ps(acc1, _mm256_andnot_ps(sign_mask, diff1));
+        }
+        if (float sum = HorizontalSum(_mm256_add_ps(acc0, acc1)); static_cast<double>(sum) > bound) {
+            return sum;
+        }
+    }
+    for (; i + kWidth <= num_dimensions; i += kWidth) {
+        __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        acc0 = _mm256_add_ps(acc0, _mm256_andnot_ps(sign_mask, diff));
+    }
+
+    float sum = HorizontalSum(_mm256_add_ps(acc0, acc1));
+    for (; i < num_dimensions; i++) {
+        sum += std::abs(a[i] - b[i]);
+    }
+    return sum;
+}
+
+template <>
+__attribute__((target("avx2,fma"))) double Distance<float>::L2Avx2(PointView<float> pt1, PointView<float> pt2,
+                                                                double bound) {
+    constexpr size_t kWidth = 8;
+    const size_t num_dimensions = pt1.size();
+    const float* a = pt1.data();
+    const float* b = pt2.data();
+    const double squared_bound = bound * bound;
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+
+    size_t i = 0;
+    for (; i + Global::kDistanceBlockSize <= num_dimensions;) {
+        for (size_t block_end = i + Global::kDistanceBlockSize; i < block_end; i += 2 * kWidth) {
+            __m256 diff0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+            __m256 diff1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + kWidth), _mm256_loadu_ps(b + i + kWidth));
+            acc0 = _mm256_fmadd_ps(diff0, diff0, acc0);
+            acc1 = _mm256_fmadd_ps(diff1, diff1, acc1);
+        }
+        if (float sum = HorizontalSum(_mm256_add_ps(acc0, acc1)); static_cast<double>(sum) > squared_bound) {
+            return std::sqrt(static_cast<double>(sum));
+        }
+    }
+    for (; i + kWidth <= num_dimensions; i += kWidth) {
+        __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        acc0 = _mm256_fmadd_ps(diff, diff, acc0);
+    }
+
+    float sum = HorizontalSum(_mm256_add_ps(acc0, acc1));
+    for (; i < num_dimensions; i++) {
+        float diff = a[i] - b[i];
+        sum += diff * diff;
+    }
+    return std::sqrt(static_cast<double>(sum));
+}
+
+// ---------- AVX-512 Kernels (float32) ----------
+template <>
+__attribute__((target("avx512f"))) double Distance<float>::L1Avx512(PointView<float> pt1, PointView<float> pt2,
+                                                                 double bound) {
+    constexpr size_t kWidth = 16;
+    const size_t num_dimensions = pt1.size();
+    const float* a = pt1.data();
+    const float* b = pt2.data();
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+
+    size_t i = 0;
+    for (; i + Global::kDistanceBlockSize <= num_dimensions;) {
+        for (size_t block_end = i + Global::kDistanceBlockSize; i < block_end; i += 2 * kWidth) {
+            __m512 diff0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+            __m512 diff1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + kWidth), _mm512_loadu_ps(b + i + kWidth));
+            acc0 = _mm512_add_ps(acc0, _mm512_abs_ps(diff0));
+            acc1 = _mm512_add_ps(acc1, _mm512_abs_ps(diff1));
+        }
+        if (float sum = _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1)); static_cast<double>(sum) > bound) {
+            return sum;
+        }
+    }
+    for (; i < num_dimensions; i += kWidth) {
+        auto mask = static_cast<__mmask16>((1U << std::min(num_dimensions - i, kWidth)) - 1);
+        __m512 diff = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i));
+        acc0 = _mm512_add_ps(acc0, _mm512_abs_ps(diff));
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+}
+
+template <>
+__attribute__((target("avx512f"))) double Distance<float>::L2Avx512(PointView<float> pt1, PointView<float> pt2,
+                                                                 double bound) {
+    constexpr size_t kWidth = 16;
+    const size_t num_dimensions = pt1.size();
+    const float* a = pt1.data();
+    const float* b = pt2.data();
+    const double squared_bound = bound * bound;
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+
+    size_t i = 0;
+    for (; i + Global::kDistanceBlockSize <= num_dimensions;) {
+        for (size_t block_end = i + Global::kDistanceBlockSize; i < block_end; i += 2 * kWidth) {
+            __m512 diff0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+            __m512 diff1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + kWidth), _mm512_loadu_ps(b + i + kWidth));
+            acc0 = _mm512_fmadd_ps(diff0, diff0, acc0);
+            acc1 = _mm512_fmadd_ps(diff1, diff1, acc1);
+        }
+        if (float sum = _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1)); static_cast<double>(sum) > squared_bound) {
+            return std::sqrt(static_cast<double>(sum));
+        }
+    }
+    for (; i < num_dimensions; i += kWidth) {
+        auto mask = static_cast<__mmask16>((1U << std::min(num_dimensions - i, kWidth)) - 1);
+        __m512 diff = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i));
+        acc0 = _mm512_fmadd_ps(diff, diff, acc0);
+    }
+    return std::sqrt(static_cast<double>(_mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1))));
+}
+#endif
+
+template class Distance<float>;
+template class Distance<double>;
@@ -0,0 +1,41 @@
+#ifndef DISTANCE_H_
+#define DISTANCE_H_
+
+#include <limits>
+
+#include "types.h"
+
+// Computes the distance between two points, but may stop as soon as the partial distance exceeds bound. In that case
+// the returned value is only guaranteed to be greater than bound.
+template <typename T>
+using DistanceFunction = double (*)(PointView<T> pt1, PointView<T> pt2, double bound);
+
+// Distance kernels over points stored as T. The kernels accumulate in T, so float32 data is never widened.
+template <typename T>
+class Distance {
+   public:
+    // Returns the fastest kernel of the given norm order that the running CPU supports.
+    static DistanceFunction<T> Get(double norm_order);
+
+    static double L1(PointView<T> pt1, PointView<T> pt2, double bound = std::numeric_limits<double>::max());
+    static double L2(PointView<T> pt1, PointView<T> pt2, double bound = std::numeric_limits<double>::max());
+
+   private:
+    struct Kernels {
+        DistanceFunction<T> l1;
+        DistanceFunction<T> l2;
+    };
+
+    static const Kernels& GetKernels();
+
+    static double L1Scalar(PointView<T> pt1, PointView<T> pt2, double bound);
+    static double L2Scalar(PointView<T> pt1, PointView<T> pt2, double bound);
+#if defined(__x86_64__)
+    static double L1Avx2(PointView<T> pt1, PointView<T> pt2, double bound);
+    static double L2Avx2(PointView<T> pt1, PointView<T> pt2, double bound);
+    static double L1Avx512(PointView<T> pt1, PointView<T> pt2, double bound);
+    static double L2Avx512(PointView<T> pt1, PointView<T> pt2, double bound);
+#endif
+};
+
+#endif
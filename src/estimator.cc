@@ -2,55 +2,356 @@
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cmath>
 #include <cstdlib>
 #include <filesystem>
 #include <format>
-#include <fstream>
-#include <ios>
 #include <memory>
+#include <mutex>
 #include <numeric>
+#include <thread>
 #include <utility>
 #include <vector>
 
 #include "ann_searcher.h"
+#include "global.h"
+#include "mapped_point_set.h"
+#include "packed_index.h"
 #include "types.h"
 #include "utils.h"
 #include "weights_generator.h"
 
+// --------------------------------------------------
+// Estimator Implementation
+// --------------------------------------------------
+std::pair<double, double> Estimator::EstimateDistances(const PointSetMetadata& a, const PointSetMetadata& b,
+                                                       double norm_order, bool in_memory) {
+    spdlog::info("Calculating the distance from {} to {}...", a.file_path.stem().string(), b.file_path.stem().string());
+    double distance_ab = EstimateDistance(a, b, norm_order, in_memory);
+
+    spdlog::info("Calculating the distance from {} to {}...", b.file_path.stem().string(), a.file_path.stem().string());
+    double distance_ba = EstimateDistance(b, a, norm_order, in_memory);
+
+    return {distance_ab, distance_ba};
+}
+
 // --------------------------------------------------
 // AnnEstimator Implementation
 // --------------------------------------------------
-AnnEstimator::AnnEstimator(std::unique_ptr<AnnSearcher> ann_searcher) : ann_searcher_(std::move(ann_searcher)) {}
+AnnEstimator::AnnEstimator(AnnSearcherFactory ann_searcher_factory, unsigned int num_threads)
+    : ann_searcher_factory_(std::move(ann_searcher_factory)), num_threads_(num_threads) {}
 
 double AnnEstimator::EstimateDistance(const PointSetMetadata& from, const PointSetMetadata& to, double norm_order,
                                       bool in_memory) {
     // Check the ANN searcher
-    if (!ann_searcher_) {
+    if (!ann_searcher_factory_) {
         spdlog::error("The ANN searcher is not set.");
     }
 
-    std::vector<double> distances;
-    ann_searcher_->Init(to, norm_order);
+    return Utils::VisitDataType(to.data_type, [&](auto type) {
+        using T = typename decltype(type)::type;
+        std::unique_ptr<AnnSearcher<T>> ann_searcher = ann_searcher_factory_.Create<T>();
+        return SumAnnDistances(*ann_searcher, from, to, norm_order, in_memory);
+    });
+}
+
+template <typename T>
+double AnnEstimator::SumAnnDistances(AnnSearcher<T>& ann_searcher, const PointSetMetadata& from,
+                                     const PointSetMetadata& to, double norm_order, bool in_memory) {
+    ann_searcher.Init(to, norm_order);
 
+    PointMatrix<T> query_set;
+    MappedPointSet<T> query_points;
     if (in_memory) {
-        std::vector<Point> query_set = Utils::LoadPointsFromFile(from.file_path, from.num_points, from.num_dimensions);
-        for (const auto& point : query_set) {
-            distances.emplace_back(ann_searcher_->Search(point).distance);
+        query_set = Utils::LoadPointsFromFile<T>(from.file_path, from.num_points, from.num_dimensions);
+    } else {
+        query_points.Open(from, AccessPattern::kSequential);
+    }
+
+    std::vector<double> distances(from.num_points);
+    unsigned int num_blocks = (from.num_points + Global::kQueryBlockSize - 1) / Global::kQueryBlockSize;
+    std::atomic<unsigned int> next_block{0};
+
+    // Each worker owns its search context and keeps claiming blocks of queries, feeding every block to the searcher at
+    // once so that it can project the whole block together.
+    auto worker = [&]() {
+        std::unique_ptr<typename AnnSearcher<T>::Context> context = ann_searcher.CreateContext();
+
+        for (unsigned int block = next_block++; block < num_blocks; block = next_block++) {
+            unsigned int first = block * Global::kQueryBlockSize;
+            unsigned int block_size = std::min(Global::kQueryBlockSize, from.num_points - first);
+            std::vector<AnnResult> results =
+                in_memory ? ann_searcher.SearchBatch(query_set.middleRows(first, block_size), *context)
+                          : ann_searcher.SearchBatch(query_points.GetPoints(first, block_size), *context);
+            for (unsigned int i = 0; i < block_size; i++) {
+                distances[first + i] = results[i].distance;
+            }
         }
+    };
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::jthread> workers;
+    for (unsigned int i = 1; i < std::min(num_threads_, num_blocks); i++) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    workers.clear();
+    auto end = std::chrono::high_resolution_clock::now();
+
+    double elapsed_time = std::chrono::duration<double, std::milli>(end - start).count();
+    spdlog::info("Answered {} queries in {:.3f} ms ({:.3f} us per query)", from.num_points, elapsed_time,
+                 elapsed_time * 1000 / from.num_points);  // NOLINT(readability-magic-numbers)
+    ann_searcher.LogStatistics();
+
+    // Sum in query order so that the result does not depend on the number of threads. This is the only place that
+    // needs double precision, whatever the scalar type of the points.
+    return std::accumulate(distances.begin(), distances.end(), 0.0);
+}
+
+// --------------------------------------------------
+// ExactEstimator Implementation
+// --------------------------------------------------
+ExactEstimator::ExactEstimator(unsigned int num_threads) : num_threads_(num_threads) {}
+
+double ExactEstimator::EstimateDistance(const PointSetMetadata& from, const PointSetMetadata& to, double norm_order,
+                                        bool in_memory) {
+    return Utils::VisitDataType(from.data_type, [&](auto type) {
+        using T = typename decltype(type)::type;
+        return SumNearestDistances<T>(from, to, norm_order, in_memory, false).first;
+    });
+}
+
+std::pair<double, double> ExactEstimator::EstimateDistances(const PointSetMetadata& a, const PointSetMetadata& b,
+                                                            double norm_order, bool in_memory) {
+    return Utils::VisitDataType(a.data_type, [&](auto type) {
+        using T = typename decltype(type)::type;
+        return SumNearestDistances<T>(a, b, norm_order, in_memory, true);
+    });
+}
+
+// NOLINTBEGIN(readability-function-cognitive-complexity)
+template <typename T>
+std::pair<double, double> ExactEstimator::SumNearestDistances(const PointSetMetadata& a, const PointSetMetadata& b,
+                                                              double norm_order, bool in_memory,
+                                                              bool both_directions) const {
+    bool use_l1 = std::abs(norm_order - 1.0) < Global::kEpsilon;
+    if (!use_l1 && std::abs(norm_order - 2.0) >= Global::kEpsilon) {  // NOLINT(readability-magic-numbers)
+        spdlog::error("Unsupported norm order: {}", norm_order);
+    }
+
+    PointMatrix<T> a_points;
+    PointMatrix<T> b_points;
+    MappedPointSet<T> a_mapped;
+    MappedPointSet<T> b_mapped;
+    if (in_memory) {
+        a_points = Utils::LoadPointsFromFile<T>(a.file_path, a.num_points, a.num_dimensions);
+        b_points = Utils::LoadPointsFromFile<T>(b.file_path, b.num_points, b.num_dimensions);
     } else {
-        std::ifstream query_file(from.file_path, std::ios::binary);
-        if (!query_file.is_open()) {
-            spdlog::error("Failed to open query file: {}", from.file_path.string());
-            return 0.0;
+        a_mapped.Open(a, AccessPattern::kSequential);
+        b_mapped.Open(b, AccessPattern::kSequential);
+    }
+
+    auto a_point = [&](unsigned int id) { return in_memory ? Utils::GetPoint(a_points, id) : a_mapped.GetPoint(id); };
+    auto b_point = [&](unsigned int id) { return in_memory ? Utils::GetPoint(b_points, id) : b_mapped.GetPoint(id); };
+    DistanceFunction<T> distance_function = Distance<T>::Get(norm_order);
+
+    // Bounds on the rounding error of the scores. The L1 kernel sums num_dimensions terms in T, while the error of the
+    // L2 scores, computed in double, grows with the squared norms of the centred points.
+    double l1_slack = static_cast<double>(a.num_dimensions + 1) * std::numeric_limits<T>::epsilon();
+    double l2_slack = 2 * (a.num_dimensions + 2) * std::numeric_limits<double>::epsilon();
+
+    // Keeps the nearer of nearest and candidate. When their scores are too close to be told apart, the exact distances
+    // given by distance_to(point_id) decide, and equal distances go to the lower point id.
+    auto keep_nearer = [](Nearest& nearest, const Nearest& candidate, auto&& distance_to) {
+        if (candidate.score - candidate.slack > nearest.score + nearest.slack) {
+            return;
+        }
+        if (candidate.score + candidate.slack < nearest.score - nearest.slack) {
+            nearest = candidate;
+            return;
         }
-        for (unsigned int point_id = 0; point_id < from.num_points; point_id++) {
-            distances.emplace_back(
-                ann_searcher_->Search(Utils::ReadPoint(query_file, from.num_dimensions, point_id)).distance);
+        double candidate_distance = distance_to(candidate.point_id);
+        double nearest_distance = distance_to(nearest.point_id);
+        if (candidate_distance < nearest_distance ||
+            (!(nearest_distance < candidate_distance) && candidate.point_id < nearest.point_id)) {
+            nearest = candidate;
         }
+    };
+
+    unsigned int num_tiles = (a.num_points + Global::kExactTileSize - 1) / Global::kExactTileSize;
+    unsigned int num_b_tiles = (b.num_points + Global::kExactTileSize - 1) / Global::kExactTileSize;
+    unsigned int num_workers = std::max(1U, std::min(num_threads_, num_tiles));
+    std::atomic<unsigned int> next_tile{0};
+
+    // Rows of A are owned by the worker that claims their tile. The column minima are shared: a worker collects those
+    // of a tile pair on its own, then merges them into the columns of the B tile under the lock of that tile, so that
+    // their memory does not grow with the number of threads.
+    std::vector<Nearest> row_nearest(a.num_points);
+    std::vector<Nearest> column_nearest(both_directions ? b.num_points : 0);
+    std::vector<std::mutex> column_mutexes(both_directions ? num_b_tiles : 0);
+
+    auto worker = [&]() {
+        std::vector<Nearest> tile_columns(both_directions ? Global::kExactTileSize : 0);
+        Eigen::MatrixXd scores;
+        Eigen::VectorXd a_norms;
+        Eigen::RowVectorXd b_norms;
+        for (unsigned int tile = next_tile++; tile < num_tiles; tile = next_tile++) {
+            unsigned int a_first = tile * Global::kExactTileSize;
+            unsigned int a_size = std::min(Global::kExactTileSize, a.num_points - a_first);
+            PointMatrixRef<T> a_tile = in_memory ? PointMatrixRef<T>(a_points.middleRows(a_first, a_size))
+                                                 : PointMatrixRef<T>(a_mapped.GetPoints(a_first, a_size));
+
+            // Every A tile starts at a different B tile, so that the workers seldom wait for the same lock.
+            for (unsigned int step = 0; step < num_b_tiles; step++) {
+                unsigned int b_tile_id = (tile + step) % num_b_tiles;
+                unsigned int b_first = b_tile_id * Global::kExactTileSize;
+                unsigned int b_size = std::min(Global::kExactTileSize, b.num_points - b_first);
+                PointMatrixRef<T> b_tile = in_memory ? PointMatrixRef<T>(b_points.middleRows(b_first, b_size))
+                                                     : PointMatrixRef<T>(b_mapped.GetPoints(b_first, b_size));
+
+                if (use_l1) {
+                    ComputeL1Scores<T>(a_tile, b_tile, scores);
+                } else {
+                    ComputeL2Scores<T>(a_tile, b_tile, scores, a_norms, b_norms);
+                }
+
+                // Scores are column-major, so walk them column by column.
+                for (unsigned int j = 0; j < b_size; j++) {
+                    unsigned int b_id = b_first + j;
+                    for (unsigned int i = 0; i < a_size; i++) {
+                        unsigned int a_id = a_first + i;
+                        double score = scores(i, j);
+                        double slack = use_l1 ? l1_slack * score : l2_slack * (a_norms(i) + b_norms(j));
+                        keep_nearer(row_nearest[a_id], Nearest{.score = score, .slack = slack, .point_id = b_id},
+                                    [&](unsigned int id) {
+                                        return distance_function(a_point(a_id), b_point(id),
+                                                                 std::numeric_limits<double>::max());
+                                    });
+                        if (both_directions) {
+                            keep_nearer(tile_columns[j], Nearest{.score = score, .slack = slack, .point_id = a_id},
+                                        [&](unsigned int id) {
+                                            return distance_function(a_point(id), b_point(b_id),
+                                                                     std::numeric_limits<double>::max());
+                                        });
+                        }
+                    }
+                }
+
+                // Merge with the same rule, which picks the nearest point whatever the order of the tiles, so that the
+                // result does not depend on the scheduling.
+                if (both_directions) {
+                    std::scoped_lock lock(column_mutexes[b_tile_id]);
+                    for (unsigned int j = 0; j < b_size; j++) {
+                        unsigned int b_id = b_first + j;
+                        keep_nearer(column_nearest[b_id], tile_columns[j], [&](unsigned int id) {
+                            return distance_function(a_point(id), b_point(b_id), std::numeric_limits<double>::max());
+                        });
+                        tile_columns[j] = Nearest{};
+                    }
+                }
+            }
+        }
+    };
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::jthread> workers;
+    for (unsigned int i = 1; i < num_workers; i++) {
+        workers.emplace_back(worker);
     }
+    worker();
+    workers.clear();
 
-    return std::accumulate(distances.begin(), distances.end(), 0.0);
+    // The scores are only used to pick the nearest neighbors, whose distances are computed again with the distance
+    // kernel and summed in double.
+    double a_to_b = 0.0;
+    double b_to_a = 0.0;
+    for (unsigned int i = 0; i < a.num_points; i++) {
+        a_to_b += distance_function(a_point(i), b_point(row_nearest[i].point_id), std::numeric_limits<double>::max());
+    }
+    for (unsigned int j = 0; j < b.num_points && both_directions; j++) {
+        b_to_a +=
+            distance_function(b_point(j), a_point(column_nearest[j].point_id), std::numeric_limits<double>::max());
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    double elapsed_time = std::chrono::duration<double, std::milli>(end - start).count();
+    spdlog::info("Compared {} x {} points in {:.3f} ms", a.num_points, b.num_points, elapsed_time);
+
+    return {a_to_b, b_to_a};
+}
+// NOLINTEND(readability-function-cognitive-complexity)
+
+template <typename T>
+void ExactEstimator::ComputeL2Scores(const PointMatrixRef<T>& a, const PointMatrixRef<T>& b, Eigen::MatrixXd& scores,
+                                     Eigen::VectorXd& a_norms, Eigen::RowVectorXd& b_norms) {
+    // ||a - b||^2 = ||a||^2 + ||b||^2 - 2 a.b, where all the dot products of the two tiles come from a single GEMM.
+    // Centring both tiles on the same point leaves the distances unchanged but keeps the norms, and so the cancellation
+    // between the terms, of the order of the distances within the tile.
+    Eigen::RowVectorXd centre = a.template cast<double>().colwise().mean();
+    Eigen::MatrixXd a_centred = a.template cast<double>().rowwise() - centre;
+    Eigen::MatrixXd b_centred = b.template cast<double>().rowwise() - centre;
+    a_norms = a_centred.rowwise().squaredNorm();
+    b_norms = b_centred.rowwise().squaredNorm().transpose();
+    scores.noalias() = a_centred * b_centred.transpose();
+    scores *= -2.0;  // NOLINT(readability-magic-numbers)
+    scores.colwise() += a_norms;
+    scores.rowwise() += b_norms;
+}
+
+template <typename T>
+void ExactEstimator::ComputeL1Scores(const PointMatrixRef<T>& a, const PointMatrixRef<T>& b, Eigen::MatrixXd& scores) {
+    constexpr size_t kRows = 4;
+    constexpr size_t kColumns = 16;
+    auto num_a = static_cast<size_t>(a.rows());
+    auto num_b = static_cast<size_t>(b.rows());
+    auto num_dimensions = static_cast<size_t>(a.cols());
+
+    // Column-major copy of the B tile, so that the k-th coordinates of consecutive points of B are contiguous.
+    Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> b_columns = b;
+    scores.resize(a.rows(), b.rows());
+
+    auto score_pair = [&](size_t i, size_t j) {
+        scores(i, j) = Distance<T>::L1(Utils::GetPoint(a, static_cast<unsigned int>(i)),
+                                       Utils::GetPoint(b, static_cast<unsigned int>(j)));
+    };
+
+    size_t i = 0;
+    for (; i + kRows <= num_a; i += kRows) {
+        size_t j = 0;
+        for (; j + kColumns <= num_b; j += kColumns) {
+            // Register block of kRows x kColumns sums: every loaded coordinate of A is reused kColumns times and every
+            // loaded coordinate of B kRows times, and the inner loop vectorizes over the points of B.
+            std::array<std::array<T, kColumns>, kRows> sums{};
+            for (size_t k = 0; k < num_dimensions; k++) {
+                const T* b_k = b_columns.data() + k * num_b + j;
+                for (size_t r = 0; r < kRows; r++) {
+                    T a_rk = a(i + r, k);
+                    for (size_t c = 0; c < kColumns; c++) {
+                        sums[r][c] += std::abs(a_rk - b_k[c]);
+                    }
+                }
+            }
+            for (size_t r = 0; r < kRows; r++) {
+                for (size_t c = 0; c < kColumns; c++) {
+                    scores(i + r, j + c) = sums[r][c];
+                }
+            }
+        }
+        for (; j < num_b; j++) {
+            for (size_t r = 0; r < kRows; r++) {
+                score_pair(i + r, j);
+            }
+        }
+    }
+    for (; i < num_a; i++) {
+        for (size_t j = 0; j < num_b; j++) {
+            score_pair(i, j);
+        }
+    }
 }
 
 // --------------------------------------------------
@@ -75,10 +376,9 @@ double SamplingEstimator::EstimateDistance(const PointSetMetadata& from, const P
     unsigned int updated_num_samples = num_samples_;
     if (updated_num_samples == 0) {
         if ([[maybe_unused]] auto* disk_qalsh = dynamic_cast<DiskQalshWeightsGenerator*>(weights_generator_.get())) {
-            std::filesystem::path qalsh_config_path = to.file_path.parent_path() / "index" /
-                                                      std::format("l{}", norm_order) / to.file_path.stem() /
-                                                      "config.json";
-            QalshConfig config = Utils::LoadQalshConfig(qalsh_config_path);
+            std::filesystem::path index_directory =
+                to.file_path.parent_path() / "index" / std::format("l{}", norm_order) / to.file_path.stem();
+            QalshConfig config = PackedIndex::LoadConfig(index_directory);
             updated_num_samples =
                 static_cast<unsigned int>(std::ceil(1 / (error_probability_ * (config.approximation_ratio - 1))));
         } else {
@@ -97,34 +397,46 @@ double SamplingEstimator::EstimateDistance(const PointSetMetadata& from, const P
     }
 
     // Sample the points using the generated weights.
+    return Utils::VisitDataType(to.data_type, [&](auto type) {
+        using T = typename decltype(type)::type;
+        return SampleDistance<T>(from, to, norm_order, in_memory, weights, updated_num_samples);
+    });
+}
+
+template <typename T>
+double SamplingEstimator::SampleDistance(const PointSetMetadata& from, const PointSetMetadata& to, double norm_order,
+                                         bool in_memory, const std::vector<double>& weights,
+                                         unsigned int num_samples) {
     double estimation = 0.0;
     double sum = std::accumulate(weights.begin(), weights.end(), 0.0);
     spdlog::info("Total sum of weights: {}", sum);
 
-    std::unique_ptr<AnnSearcher> ann_searcher;
+    std::unique_ptr<AnnSearcher<T>> ann_searcher;
+    std::unique_ptr<typename AnnSearcher<T>::Context> context;
 
     auto processing_loop = [&](auto&& get_point_by_id) {
-        for (unsigned int cnt = 1; cnt <= updated_num_samples; cnt++) {
+        for (unsigned int cnt = 1; cnt <= num_samples; cnt++) {
             unsigned int point_id = Utils::SampleFromWeights(weights);
-            estimation += (sum * ann_searcher->Search(get_point_by_id(point_id)).distance / weights[point_id]);
+            estimation +=
+                (sum * ann_searcher->Search(get_point_by_id(point_id), *context).distance / weights[point_id]);
         }
     };
 
     if (in_memory) {
-        ann_searcher = std::make_unique<InMemoryLinearScanAnnSearcher>();
+        ann_searcher = std::make_unique<InMemoryLinearScanAnnSearcher<T>>();
         ann_searcher->Init(to, norm_order);
-        std::vector<Point> query_set = Utils::LoadPointsFromFile(from.file_path, from.num_points, from.num_dimensions);
-        processing_loop([&](unsigned int id) { return query_set[id]; });
+        context = ann_searcher->CreateContext();
+        PointMatrix<T> query_set = Utils::LoadPointsFromFile<T>(from.file_path, from.num_points, from.num_dimensions);
+        processing_loop([&](unsigned int id) { return Utils::GetPoint(query_set, id); });
     } else {
-        ann_searcher = std::make_unique<DiskLinearScanAnnSearcher>();
+        ann_searcher = std::make_unique<DiskLinearScanAnnSearcher<T>>();
         ann_searcher->Init(to, norm_order);
-        std::ifstream query_file(from.file_path, std::ios::binary);
-        if (!query_file.is_open()) {
-            spdlog::error("Failed to open query file: {}", from.file_path.string());
-            return 0.0;
-        }
-        processing_loop([&](unsigned int id) { return Utils::ReadPoint(query_file, from.num_dimensions, id); });
+        context = ann_searcher->CreateContext();
+        // Sampled queries are scattered over the file.
+        MappedPointSet<T> query_points;
+        query_points.Open(from, AccessPattern::kRandom);
+        processing_loop([&](unsigned int id) { return query_points.GetPoint(id); });
     }
 
-    return estimation / updated_num_samples;
+    return estimation / num_samples;
 }
\ No newline at end of file
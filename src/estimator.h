@@ -1,7 +1,10 @@
 #ifndef ESTIMATOR_H_
 #define ESTIMATOR_H_
 
+#include <limits>
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include "ann_searcher.h"
 #include "weights_generator.h"
@@ -11,16 +14,62 @@ class Estimator {
     virtual ~Estimator() = default;
     virtual double EstimateDistance(const PointSetMetadata& from, const PointSetMetadata& to, double norm_order,
                                     bool in_memory) = 0;
+
+    // Estimates the distances from a to b and from b to a. By default these are two independent runs; estimators
+    // that can get both from a single sweep over the pairs override it.
+    virtual std::pair<double, double> EstimateDistances(const PointSetMetadata& a, const PointSetMetadata& b,
+                                                        double norm_order, bool in_memory);
 };
 
 class AnnEstimator : public Estimator {
    public:
-    AnnEstimator(std::unique_ptr<AnnSearcher> ann_searcher);
+    AnnEstimator(AnnSearcherFactory ann_searcher_factory, unsigned int num_threads);
+    double EstimateDistance(const PointSetMetadata& from, const PointSetMetadata& to, double norm_order,
+                            bool in_memory) override;
+
+   private:
+    template <typename T>
+    double SumAnnDistances(AnnSearcher<T>& ann_searcher, const PointSetMetadata& from, const PointSetMetadata& to,
+                           double norm_order, bool in_memory);
+
+    AnnSearcherFactory ann_searcher_factory_;
+    unsigned int num_threads_;
+};
+
+// Computes the exact Chamfer distance by comparing A and B tile by tile. Every tile yields both its row minima (A to B)
+// and its column minima (B to A), so one pass gives both directions; a single direction skips the column minima.
+class ExactEstimator : public Estimator {
+   public:
+    ExactEstimator(unsigned int num_threads);
     double EstimateDistance(const PointSetMetadata& from, const PointSetMetadata& to, double norm_order,
                             bool in_memory) override;
+    std::pair<double, double> EstimateDistances(const PointSetMetadata& a, const PointSetMetadata& b, double norm_order,
+                                                bool in_memory) override;
 
    private:
-    std::unique_ptr<AnnSearcher> ann_searcher_;
+    // Nearest neighbor found so far, scored by the squared distance for L2 and by the distance for L1. The slack bounds
+    // the rounding error of the score, so that two scores closer than their slacks are compared on exact distances.
+    struct Nearest {
+        double score{std::numeric_limits<double>::max()};
+        double slack{0.0};
+        unsigned int point_id{0};
+    };
+
+    template <typename T>
+    std::pair<double, double> SumNearestDistances(const PointSetMetadata& a, const PointSetMetadata& b,
+                                                  double norm_order, bool in_memory, bool both_directions) const;
+
+    // Scores the tiles in double over points centred on the mean of the A tile, which keeps the expansion of the
+    // squared distance from cancelling when the points lie far from the origin. Also returns the centred squared norms,
+    // which bound the error of the scores.
+    template <typename T>
+    static void ComputeL2Scores(const PointMatrixRef<T>& a, const PointMatrixRef<T>& b, Eigen::MatrixXd& scores,
+                                Eigen::VectorXd& a_norms, Eigen::RowVectorXd& b_norms);
+
+    template <typename T>
+    static void ComputeL1Scores(const PointMatrixRef<T>& a, const PointMatrixRef<T>& b, Eigen::MatrixXd& scores);
+
+    unsigned int num_threads_;
 };
 
 class SamplingEstimator : public Estimator {
@@ -31,6 +80,10 @@ class SamplingEstimator : public Estimator {
                             bool in_memory) override;
 
    private:
+    template <typename T>
+    double SampleDistance(const PointSetMetadata& from, const PointSetMetadata& to, double norm_order, bool in_memory,
+                          const std::vector<double>& weights, unsigned int num_samples);
+
     std::unique_ptr<WeightsGenerator> weights_generator_;
     unsigned int num_samples_;
     double approximation_ratio_;
@@ -0,0 +1,101 @@
+#include "external_sorter.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <queue>
+#include <utility>
+
+template <typename T>
+ExternalSorter<T>::ExternalSorter(std::filesystem::path file_path, size_t memory_budget)
+    : file_path_(std::move(file_path)), memory_budget_(memory_budget) {
+    ofs_.open(file_path_, std::ios::binary | std::ios::trunc);
+    if (!ofs_.is_open()) {
+        spdlog::error("Failed to open file for writing: {}", file_path_.string());
+    }
+}
+
+template <typename T>
+ExternalSorter<T>::~ExternalSorter() {
+    ofs_.close();
+    std::error_code error;
+    std::filesystem::remove(file_path_, error);
+}
+
+template <typename T>
+void ExternalSorter<T>::AddRun(std::vector<DotProductPointIdPair<T>>& run) {
+    std::ranges::sort(run, CompareDotProductPointIdPair{});
+    ofs_.write(reinterpret_cast<const char*>(run.data()),
+               static_cast<std::streamsize>(run.size() * sizeof(DotProductPointIdPair<T>)));
+    if (!ofs_) {
+        spdlog::error("Failed to write a run to {}", file_path_.string());
+    }
+    run_offsets_.push_back(run_offsets_.back() + run.size());
+}
+
+template <typename T>
+void ExternalSorter<T>::Merge(const std::function<void(const DotProductPointIdPair<T>&)>& consume) {
+    ofs_.close();
+    std::ifstream ifs(file_path_, std::ios::binary);
+    if (!ifs.is_open()) {
+        spdlog::error("Failed to open file: {}", file_path_.string());
+    }
+
+    struct Run {
+        size_t next_offset;
+        size_t end_offset;
+        std::vector<DotProductPointIdPair<T>> buffer;
+        size_t position;
+    };
+    size_t num_runs = run_offsets_.size() - 1;
+    size_t buffer_size =
+        std::max<size_t>(1, memory_budget_ / sizeof(DotProductPointIdPair<T>) / std::max<size_t>(1, num_runs));
+
+    auto refill = [&](Run& run) {
+        size_t count = std::min(buffer_size, run.end_offset - run.next_offset);
+        run.buffer.resize(count);
+        ifs.seekg(static_cast<std::streamoff>(run.next_offset * sizeof(DotProductPointIdPair<T>)));
+        ifs.read(reinterpret_cast<char*>(run.buffer.data()),
+                 static_cast<std::streamsize>(count * sizeof(DotProductPointIdPair<T>)));
+        if (!ifs) {
+            spdlog::error("Failed to read a run from {}", file_path_.string());
+        }
+        run.next_offset += count;
+        run.position = 0;
+    };
+
+    // The heap holds the next pair of every run that is not exhausted, and pops the smallest pair first.
+    using Head = std::pair<DotProductPointIdPair<T>, size_t>;
+    auto compare = [](const Head& lhs, const Head& rhs) {
+        return CompareDotProductPointIdPair{}(rhs.first, lhs.first);
+    };
+    std::priority_queue<Head, std::vector<Head>, decltype(compare)> heap(compare);
+
+    std::vector<Run> runs(num_runs);
+    for (size_t i = 0; i < num_runs; i++) {
+        runs[i].next_offset = run_offsets_[i];
+        runs[i].end_offset = run_offsets_[i + 1];
+        refill(runs[i]);
+        if (!runs[i].buffer.empty()) {
+            heap.emplace(runs[i].buffer.front(), i);
+        }
+    }
+
+    while (!heap.empty()) {
+        auto [pair, run_id] = heap.top();
+        heap.pop();
+        consume(pair);
+
+        Run& run = runs[run_id];
+        if (++run.position == run.buffer.size()) {
+            if (run.next_offset == run.end_offset) {
+                continue;
+            }
+            refill(run);
+        }
+        heap.emplace(run.buffer[run.position], run_id);
+    }
+}
+
+template class ExternalSorter<float>;
+template class ExternalSorter<double>;
@@ -0,0 +1,36 @@
+#ifndef EXTERNAL_SORTER_H_
+#define EXTERNAL_SORTER_H_
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <vector>
+
+#include "types.h"
+
+// Sorts more pairs than fit in memory, in the order of CompareDotProductPointIdPair. The pairs are added in runs, each
+// of which is sorted and appended to a temporary file. Merge then reads all the runs back at once, through one buffer
+// per run, and these buffers take at most memory_budget bytes together.
+template <typename T>
+class ExternalSorter {
+   public:
+    ExternalSorter(std::filesystem::path file_path, size_t memory_budget);
+    ~ExternalSorter();
+    ExternalSorter(const ExternalSorter&) = delete;
+    ExternalSorter& operator=(const ExternalSorter&) = delete;
+
+    // Sorts the run in place and appends it to the file.
+    void AddRun(std::vector<DotProductPointIdPair<T>>& run);
+    // Passes every pair added so far to consume, in sorted order.
+    void Merge(const std::function<void(const DotProductPointIdPair<T>&)>& consume);
+
+   private:
+    std::filesystem::path file_path_;
+    size_t memory_budget_;
+    std::ofstream ofs_;
+    // Run i is made of the pairs [run_offsets_[i], run_offsets_[i + 1]) of the file.
+    std::vector<size_t> run_offsets_{0};
+};
+
+#endif
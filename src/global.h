@@ -2,6 +2,8 @@
 #define GLOBAL_H_
 
 #include <cmath>
+#include <cstddef>
+#include <limits>
 #include <numbers>
 
 class Global {
@@ -12,7 +14,31 @@ class Global {
     static constexpr double kSamplingDefaultErrorProbability = 0.1;
     static constexpr double kDefaultApproximationRatio = 2.0;
     static constexpr unsigned int kNumCandidates = 100;
+    // With a quantized index, only this many of the candidates closest to the query are re-ranked exactly.
+    static constexpr unsigned int kNumRerankCandidates = 10;
     static constexpr unsigned int kScanSize = 128;
+    static constexpr unsigned int kQueryBlockSize = 1024;
+    // The disk linear scan reads the base file in chunks of about this many bytes, once per block of queries.
+    static constexpr size_t kScanChunkBytes = size_t{1} << 20;
+    // The exact estimator compares tiles of this many points of A against tiles of this many points of B.
+    static constexpr unsigned int kExactTileSize = 512;
+    // Page budget of the buffer pool that caches the B+ tree pages of a disk QALSH index.
+    static constexpr size_t kBufferPoolBytes = size_t{64} << 20;
+    // By default, disk QALSH pins every internal level of its B+ trees in memory.
+    static constexpr unsigned int kDefaultNumPinnedLevels = std::numeric_limits<unsigned int>::max();
+    // A disk QALSH scan prefetches at most this many sibling leaves ahead of its cursor.
+    static constexpr unsigned int kMaxReadaheadLeaves = 16;
+    // Weight of the latest query in the running mean of the leaves a scan steps to, which sizes its readahead.
+    static constexpr double kReadaheadDecay = 0.5;
+    // Buffers that direct I/O reads into are aligned to this many bytes, which covers the block size of any device.
+    static constexpr size_t kDirectIoAlignment = 4096;
+    // The B+ tree bulk loader appends pages to a buffer of this many bytes and writes it out whenever it fills up.
+    static constexpr size_t kWriteBufferBytes = size_t{4} << 20;
+    // Disk QALSH reads the points of candidates that are at most this many bytes apart in the file as one range.
+    static constexpr size_t kMaxReadGapBytes = size_t{16} << 10;
+    // Distance kernels only compare against the early-abandoning bound once per block of this many coordinates. It
+    // must be a multiple of 32 so that every block is made of whole unrolled AVX-512 iterations for float32 too.
+    static constexpr size_t kDistanceBlockSize = 64;
 
     static bool kUseFixedSeed;
     static constexpr unsigned int kDefaultSeed = 42;
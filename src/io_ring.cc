@@ -0,0 +1,222 @@
+#include "io_ring.h"
+
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <utility>
+
+// The ring indices are shared with the kernel, which reads and writes them concurrently.
+unsigned int IoRing::LoadAcquire(unsigned int* index) {
+    return std::atomic_ref<unsigned int>(*index).load(std::memory_order_acquire);
+}
+
+void IoRing::StoreRelease(unsigned int* index, unsigned int value) {
+    std::atomic_ref<unsigned int>(*index).store(value, std::memory_order_release);
+}
+
+IoRing::~IoRing() { Close(); }
+
+void IoRing::Open(unsigned int num_entries) {
+    Close();
+
+    io_uring_params params{};
+    auto ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, std::max(1U, num_entries), &params));
+    if (ring_fd < 0) {
+        static std::once_flag warned;
+        std::call_once(warned,
+                       [] { spdlog::warn("io_uring is not available: {}. Using pread.", std::strerror(errno)); });
+        return;
+    }
+    ring_fd_ = ring_fd;
+    num_entries_ = params.sq_entries;
+
+    // Kernels before 5.6 set up a ring but reject IORING_OP_READ, and have no probe either.
+    if (!SupportsRead()) {
+        close(ring_fd_);
+        ring_fd_ = -1;
+        static std::once_flag warned;
+        std::call_once(warned, [] { spdlog::warn("io_uring does not support reads. Using pread."); });
+        return;
+    }
+
+    // Map the submission and completion rings, which share one mapping on recent kernels, and the submission entries.
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        sq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                    IORING_OFF_SQ_RING);
+    if (single_mmap) {
+        cq_ring_ = sq_ring_;
+        cq_ring_size_ = 0;
+    } else {
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                        IORING_OFF_CQ_RING);
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(
+        mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES));
+    if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED || sqes_ == MAP_FAILED) {
+        spdlog::error("Failed to map the io_uring rings: {}", std::strerror(errno));
+    }
+
+    auto* sq_ring = static_cast<char*>(sq_ring_);
+    sq_tail_ = reinterpret_cast<unsigned int*>(sq_ring + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned int*>(sq_ring + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned int*>(sq_ring + params.sq_off.array);
+    auto* cq_ring = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned int*>(cq_ring + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned int*>(cq_ring + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned int*>(cq_ring + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq_ring + params.cq_off.cqes);
+}
+
+void IoRing::Close() {
+    if (ring_fd_ == -1) {
+        return;
+    }
+    munmap(sqes_, sqes_size_);
+    if (cq_ring_size_ != 0) {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    munmap(sq_ring_, sq_ring_size_);
+    close(ring_fd_);
+    ring_fd_ = -1;
+    reads_.clear();
+    num_queued_ = 0;
+    num_in_flight_ = 0;
+}
+
+bool IoRing::SupportsRead() const {
+    constexpr unsigned int kNumProbeOps = 256;
+    std::vector<char> buffer(sizeof(io_uring_probe) + kNumProbeOps * sizeof(io_uring_probe_op));
+    auto* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+    if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PROBE, probe, kNumProbeOps) < 0) {
+        return false;
+    }
+    return probe->last_op >= IORING_OP_READ && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) != 0;
+}
+
+void IoRing::AddRead(int file_descriptor, char* buffer, unsigned int size, uint64_t offset) {
+    Read read{.file_descriptor = file_descriptor, .buffer = buffer, .size = size, .offset = offset, .completed = false};
+    if (num_queued_ + num_in_flight_ == num_entries_ && available()) {
+        Wait();
+    }
+    // Waiting may have closed the ring.
+    if (!available()) {
+        ReadFully(read, 0);
+        return;
+    }
+
+    unsigned int tail = *sq_tail_;
+    unsigned int index = tail & *sq_mask_;
+    io_uring_sqe& sqe = sqes_[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READ;
+    sqe.fd = file_descriptor;
+    sqe.addr = reinterpret_cast<uint64_t>(buffer);
+    sqe.len = size;
+    sqe.off = offset;
+    sqe.user_data = reads_.size();
+    reads_.push_back(read);
+    sq_array_[index] = index;
+    StoreRelease(sq_tail_, tail + 1);
+    num_queued_++;
+}
+
+void IoRing::Wait() {
+    while (num_queued_ + num_in_flight_ > 0) {
+        Submit(1);
+        if (!available()) {
+            break;
+        }
+        ReapCompletions();
+    }
+    reads_.clear();
+}
+
+void IoRing::Submit(unsigned int min_complete) {
+    long num_submitted = syscall(__NR_io_uring_enter, ring_fd_, num_queued_, min_complete, IORING_ENTER_GETEVENTS,
+                                 nullptr, 0);
+    if (num_submitted < 0) {
+        // The call was interrupted, or the completion queue is full: reap what completed and try again.
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+            return;
+        }
+        FallBackToPread();
+        return;
+    }
+    num_queued_ -= static_cast<unsigned int>(num_submitted);
+    num_in_flight_ += static_cast<unsigned int>(num_submitted);
+}
+
+void IoRing::ReapCompletions() {
+    unsigned int head = *cq_head_;
+    unsigned int tail = LoadAcquire(cq_tail_);
+    for (; head != tail; head++) {
+        const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+        Read& read = reads_[cqe.user_data];
+        // A failed read is done again with pread, which reports the error if it persists. A short one is completed
+        // with pread, which also zeroes the tail of the buffer at the end of the file.
+        unsigned int done = cqe.res < 0 ? 0 : static_cast<unsigned int>(cqe.res);
+        if (done < read.size) {
+            ReadFully(read, done);
+        }
+        read.completed = true;
+        num_in_flight_--;
+    }
+    StoreRelease(cq_head_, head);
+}
+
+void IoRing::FallBackToPread() {
+    int error = errno;
+    static std::once_flag warned;
+    std::call_once(warned, [error] {
+        spdlog::warn("Failed to submit reads to io_uring: {}. Using pread.", std::strerror(error));
+    });
+
+    // Closing the ring lets the kernel finish or cancel the reads in flight. Reading them again only writes the same
+    // bytes.
+    std::vector<Read> reads = std::exchange(reads_, {});
+    Close();
+    for (const Read& read : reads) {
+        if (!read.completed) {
+            ReadFully(read, 0);
+        }
+    }
+}
+
+void IoRing::ReadFully(const Read& read, unsigned int done) {
+    while (done < read.size) {
+        // Past a short read, stop at the end of the file, which O_DIRECT may not read up to from an unaligned offset.
+        struct stat file_status {};
+        if (done > 0 && fstat(read.file_descriptor, &file_status) == 0 &&
+            read.offset + done >= static_cast<uint64_t>(file_status.st_size)) {
+            break;
+        }
+        ssize_t num_read = pread(read.file_descriptor, read.buffer + done, read.size - done,
+                                 static_cast<off_t>(read.offset + done));
+        if (num_read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            spdlog::error("Failed to read {} bytes at offset {}: {}", read.size, read.offset, std::strerror(errno));
+            return;
+        }
+        if (num_read == 0) {
+            break;
+        }
+        done += static_cast<unsigned int>(num_read);
+    }
+    std::memset(read.buffer + done, 0, read.size - done);
+}
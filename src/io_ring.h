@@ -0,0 +1,79 @@
+#ifndef IO_RING_H_
+#define IO_RING_H_
+
+#include <linux/io_uring.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A minimal io_uring instance that reads a batch of pages with a single system call. Reads are queued with AddRead and
+// all of them are in flight together until Wait returns. An instance must only be used by one thread at a time.
+//
+// When the kernel does not support io_uring or its read operation, or io_uring is disabled, the instance is not
+// available and AddRead falls back to a blocking pread. A ring that fails later on is closed, and the reads it still
+// holds are done with pread. Either way, the part of a buffer that lies past the end of the file is zeroed.
+class IoRing {
+   public:
+    IoRing() = default;
+    ~IoRing();
+    IoRing(const IoRing&) = delete;
+    IoRing& operator=(const IoRing&) = delete;
+
+    // Sets up a ring that holds up to num_entries reads in flight.
+    void Open(unsigned int num_entries);
+    void Close();
+
+    [[nodiscard]] bool available() const { return ring_fd_ != -1; }
+
+    // Queues a read of size bytes at offset into buffer. The read is submitted as soon as the ring is full.
+    void AddRead(int file_descriptor, char* buffer, unsigned int size, uint64_t offset);
+    // Submits the queued reads and waits for all the reads in flight to complete.
+    void Wait();
+
+   private:
+    struct Read {
+        int file_descriptor{-1};
+        char* buffer{nullptr};
+        unsigned int size{0};
+        uint64_t offset{0};
+        bool completed{false};
+    };
+
+    static unsigned int LoadAcquire(unsigned int* index);
+    static void StoreRelease(unsigned int* index, unsigned int value);
+    // Reads the bytes of a read from done on with pread, and zeroes those past the end of the file.
+    static void ReadFully(const Read& read, unsigned int done);
+
+    [[nodiscard]] bool SupportsRead() const;
+    void Submit(unsigned int min_complete);
+    void ReapCompletions();
+    // Closes the ring after a failure and does the reads it has not completed with pread.
+    void FallBackToPread();
+
+    int ring_fd_{-1};
+    unsigned int num_entries_{0};
+
+    void* sq_ring_{nullptr};
+    size_t sq_ring_size_{0};
+    void* cq_ring_{nullptr};
+    size_t cq_ring_size_{0};
+    io_uring_sqe* sqes_{nullptr};
+    size_t sqes_size_{0};
+
+    unsigned int* sq_tail_{nullptr};
+    unsigned int* sq_mask_{nullptr};
+    unsigned int* sq_array_{nullptr};
+    unsigned int* cq_head_{nullptr};
+    unsigned int* cq_tail_{nullptr};
+    unsigned int* cq_mask_{nullptr};
+    io_uring_cqe* cqes_{nullptr};
+
+    // Reads added since the ring was last drained, indexed by the user data of their submission entries.
+    std::vector<Read> reads_;
+    // Reads queued but not yet submitted, and reads submitted but not yet completed.
+    unsigned int num_queued_{0};
+    unsigned int num_in_flight_{0};
+};
+
+#endif
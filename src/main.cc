@@ -63,8 +63,36 @@ int main(int argc, char** argv) {
     std::filesystem::path dataset_directory;
     index->add_option("-d,--dataset-directory", dataset_directory, "Directory for the dataset")->required();
 
+    bool quantize{false};
+    index->add_flag("--quantize", quantize, "Also store int8 codes of the points to verify candidates on")
+        ->default_str(quantize ? "True" : "False");
+
+    bool compress_leaves{false};
+    index->add_flag("--compress-leaves", compress_leaves, "Store B+ tree leaves with float32 keys and packed point ids")
+        ->default_str(compress_leaves ? "True" : "False");
+
+    bool pack{false};
+    index->add_flag("--pack", pack, "Store the whole index in a single file")->default_str(pack ? "True" : "False");
+
+    bool reorder{false};
+    index->add_flag("--reorder", reorder, "Store a copy of the points in hash order to verify candidates on")
+        ->default_str(reorder ? "True" : "False");
+
+    unsigned int num_threads{0};
+    index->add_option("-t,--num-threads", num_threads, "Number of threads used to build the index")
+        ->default_val(1)
+        ->check(CLI::PositiveNumber);
+
+    size_t memory_budget{0};
+    index
+        ->add_option("-M,--memory-budget", memory_budget,
+                     "Memory budget in MB for building the index, beyond which it is sorted on disk (0: no budget)")
+        ->default_val(0);
+
     index->callback([&]() {
-        command = std::make_unique<IndexCommand>(norm_order, approximation_ratio, page_size, dataset_directory);
+        command = std::make_unique<IndexCommand>(norm_order, approximation_ratio, page_size, dataset_directory,
+                                                 quantize, compress_leaves, pack, reorder, num_threads,
+                                                 memory_budget << 20);
     });
 
     // ------------------------------
@@ -82,6 +110,10 @@ int main(int argc, char** argv) {
     estimate->add_flag("--in-memory", in_memory, "Run the algorithm in memory")
         ->default_str(in_memory ? "True" : "False");
 
+    estimate->add_option("-t,--num-threads", num_threads, "Number of threads used to answer queries")
+        ->default_val(1)
+        ->check(CLI::PositiveNumber);
+
     std::unique_ptr<Estimator> estimator;
     estimate->require_subcommand(1);
     estimate->callback([&]() {
@@ -96,13 +128,13 @@ int main(int argc, char** argv) {
     // ------------------------------
     CLI::App* ann = estimate->add_subcommand("ann", "Estimate Chamfer distance using ANN.");
 
-    std::unique_ptr<AnnSearcher> ann_searcher;
+    AnnSearcherFactory ann_searcher_factory;
     ann->require_subcommand(1);
     ann->callback([&]() {
-        if (!ann_searcher) {
+        if (!ann_searcher_factory) {
             spdlog::error("Ann searcher is not set. Please specify a Ann searcher.");
         }
-        estimator = std::make_unique<AnnEstimator>(std::move(ann_searcher));
+        estimator = std::make_unique<AnnEstimator>(std::move(ann_searcher_factory), num_threads);
     });
 
     // ------------------------------
@@ -112,9 +144,9 @@ int main(int argc, char** argv) {
 
     linear_scan->callback([&] {
         if (in_memory) {
-            ann_searcher = std::make_unique<InMemoryLinearScanAnnSearcher>();
+            ann_searcher_factory = AnnSearcherFactory::Of<InMemoryLinearScanAnnSearcher>();
         } else {
-            ann_searcher = std::make_unique<DiskLinearScanAnnSearcher>();
+            ann_searcher_factory = AnnSearcherFactory::Of<DiskLinearScanAnnSearcher>();
         }
     });
 
@@ -126,15 +158,30 @@ int main(int argc, char** argv) {
     qalsh_ann->add_option("-c, --approximation-ratio", approximation_ratio, "Approximation ratio for QALSH")
         ->default_val(Global::kDefaultApproximationRatio);
 
-    // If in_memory = false, the setting of approximation_ratio would not have any effect.
+    unsigned int num_pinned_levels{Global::kDefaultNumPinnedLevels};
+    qalsh_ann->add_option("--pinned-levels", num_pinned_levels,
+                          "Number of internal B+ tree levels kept in memory on disk (default: all)");
+
+    bool direct_io{false};
+    qalsh_ann->add_flag("--direct-io", direct_io, "Read the index and the base points on disk with O_DIRECT")
+        ->default_str(direct_io ? "True" : "False");
+
+    // If in_memory = false, the setting of approximation_ratio would not have any effect, and vice versa for
+    // num_pinned_levels and direct_io.
     qalsh_ann->callback([&] {
         if (in_memory) {
-            ann_searcher = std::make_unique<InMemoryQalshAnnSearcher>(approximation_ratio);
+            ann_searcher_factory = AnnSearcherFactory::Of<InMemoryQalshAnnSearcher>(approximation_ratio);
         } else {
-            ann_searcher = std::make_unique<DiskQalshAnnSearcher>();
+            ann_searcher_factory = AnnSearcherFactory::Of<DiskQalshAnnSearcher>(num_pinned_levels, direct_io);
         }
     });
 
+    // ------------------------------
+    // exact estimate
+    // ------------------------------
+    CLI::App* exact = estimate->add_subcommand("exact", "Compute the exact Chamfer distance tile by tile.");
+    exact->callback([&]() { estimator = std::make_unique<ExactEstimator>(num_threads); });
+
     // ------------------------------
     // sampling estimate
     // ------------------------------
@@ -177,11 +224,16 @@ int main(int argc, char** argv) {
     // ------------------------------
     CLI::App* qalsh_sampling = sampling->add_subcommand("qalsh", "Generate samples using QALSH.");
 
+    qalsh_sampling->add_option("--pinned-levels", num_pinned_levels,
+                               "Number of internal B+ tree levels kept in memory on disk (default: all)");
+    qalsh_sampling->add_flag("--direct-io", direct_io, "Read the index and the base points on disk with O_DIRECT")
+        ->default_str(direct_io ? "True" : "False");
+
     qalsh_sampling->callback([&]() {
         if (in_memory) {
             weights_generator = std::make_unique<InMemoryQalshWeightsGenerator>(approximation_ratio);
         } else {
-            weights_generator = std::make_unique<DiskQalshWeightsGenerator>();
+            weights_generator = std::make_unique<DiskQalshWeightsGenerator>(num_pinned_levels, direct_io);
         }
     });
 
@@ -0,0 +1,105 @@
+#include "mapped_point_set.h"
+
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <utility>
+
+template <typename T>
+MappedPointSet<T>::~MappedPointSet() {
+    Close();
+}
+
+template <typename T>
+MappedPointSet<T>::MappedPointSet(MappedPointSet&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr)),
+      num_bytes_(std::exchange(other.num_bytes_, 0)),
+      num_dimensions_(other.num_dimensions_) {}
+
+template <typename T>
+MappedPointSet<T>& MappedPointSet<T>::operator=(MappedPointSet&& other) noexcept {
+    if (this != &other) {
+        Close();
+        data_ = std::exchange(other.data_, nullptr);
+        num_bytes_ = std::exchange(other.num_bytes_, 0);
+        num_dimensions_ = other.num_dimensions_;
+    }
+    return *this;
+}
+
+template <typename T>
+void MappedPointSet<T>::Open(const PointSetMetadata& metadata, AccessPattern access_pattern) {
+    Close();
+    num_dimensions_ = metadata.num_dimensions;
+    num_bytes_ = static_cast<size_t>(metadata.num_points) * metadata.num_dimensions * sizeof(T);
+    if (num_bytes_ == 0) {
+        return;
+    }
+
+    int fd = open(metadata.file_path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        spdlog::error("Failed to open point set file: {}", metadata.file_path.string());
+        return;
+    }
+    // Reading past the end of the file through the mapping would raise SIGBUS.
+    struct stat file_status {};
+    if (fstat(fd, &file_status) == -1) {
+        close(fd);
+        spdlog::error("Failed to stat point set file: {}", metadata.file_path.string());
+        return;
+    }
+    if (static_cast<size_t>(file_status.st_size) < num_bytes_) {
+        close(fd);
+        spdlog::error("Point set file {} is smaller than the {} points of {} dimensions of its metadata",
+                      metadata.file_path.string(), metadata.num_points, metadata.num_dimensions);
+        return;
+    }
+    void* address = mmap(nullptr, num_bytes_, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps its own reference to the file.
+    close(fd);
+    if (address == MAP_FAILED) {
+        spdlog::error("Failed to map point set file: {}", metadata.file_path.string());
+        return;
+    }
+
+    // Sequential scans get aggressive read-ahead, while random point lookups should not drag neighboring pages in.
+    madvise(address, num_bytes_, access_pattern == AccessPattern::kSequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+    data_ = static_cast<const T*>(address);
+}
+
+template <typename T>
+void MappedPointSet<T>::Close() {
+    if (data_ != nullptr) {
+        munmap(const_cast<T*>(data_), num_bytes_);
+        data_ = nullptr;
+    }
+}
+
+template <typename T>
+PointView<T> MappedPointSet<T>::GetPoint(unsigned int point_id) const {
+    return {data_ + static_cast<size_t>(point_id) * num_dimensions_, num_dimensions_};
+}
+
+template <typename T>
+void MappedPointSet<T>::Prefetch(unsigned int first_point_id, unsigned int num_points) const {
+    // madvise needs a page-aligned start address.
+    auto page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    size_t first_value = static_cast<size_t>(first_point_id) * num_dimensions_;
+    auto begin = reinterpret_cast<uintptr_t>(data_ + first_value);
+    auto end = reinterpret_cast<uintptr_t>(data_ + first_value + static_cast<size_t>(num_points) * num_dimensions_);
+    uintptr_t aligned_begin = begin & ~(page_size - 1);
+    madvise(reinterpret_cast<void*>(aligned_begin), end - aligned_begin, MADV_WILLNEED);
+}
+
+template <typename T>
+Eigen::Map<const PointMatrix<T>> MappedPointSet<T>::GetPoints(unsigned int first_point_id,
+                                                              unsigned int num_points) const {
+    return {data_ + static_cast<size_t>(first_point_id) * num_dimensions_, num_points, num_dimensions_};
+}
+
+template class MappedPointSet<float>;
+template class MappedPointSet<double>;
@@ -0,0 +1,42 @@
+#ifndef MAPPED_POINT_SET_H_
+#define MAPPED_POINT_SET_H_
+
+#include <Eigen/Core>
+#include <cstddef>
+#include <filesystem>
+
+#include "types.h"
+
+enum class AccessPattern {
+    kSequential,
+    kRandom,
+};
+
+// Read-only memory mapping of a point set file. Points are handed out as views into the mapping, so reading them
+// costs no system call and no copy once the file is in the page cache. The mapping may be shared by several threads.
+template <typename T>
+class MappedPointSet {
+   public:
+    MappedPointSet() = default;
+    ~MappedPointSet();
+    MappedPointSet(const MappedPointSet&) = delete;
+    MappedPointSet& operator=(const MappedPointSet&) = delete;
+    MappedPointSet(MappedPointSet&& other) noexcept;
+    MappedPointSet& operator=(MappedPointSet&& other) noexcept;
+
+    void Open(const PointSetMetadata& metadata, AccessPattern access_pattern);
+    void Close();
+
+    [[nodiscard]] PointView<T> GetPoint(unsigned int point_id) const;
+    // Asks the kernel to start reading the points in the background, so that viewing them later does not block.
+    void Prefetch(unsigned int first_point_id, unsigned int num_points) const;
+    [[nodiscard]] Eigen::Map<const PointMatrix<T>> GetPoints(unsigned int first_point_id,
+                                                             unsigned int num_points) const;
+
+   private:
+    const T* data_{nullptr};
+    size_t num_bytes_{0};
+    unsigned int num_dimensions_{0};
+};
+
+#endif
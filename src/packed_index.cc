@@ -0,0 +1,64 @@
+#include "packed_index.h"
+
+#include <spdlog/spdlog.h>
+
+#include "utils.h"
+
+bool PackedIndex::Exists(const std::filesystem::path& index_directory) {
+    return std::filesystem::exists(index_directory / kFileName);
+}
+
+QalshConfig PackedIndex::LoadConfig(const std::filesystem::path& index_directory) {
+    if (Exists(index_directory)) {
+        return ReadHeader(index_directory / kFileName).config;
+    }
+    return Utils::LoadQalshConfig(index_directory / "config.json");
+}
+
+uint64_t PackedIndex::GetHeaderSize(const std::string& config, unsigned int num_hash_tables) {
+    return sizeof(uint64_t) * (3 + static_cast<uint64_t>(num_hash_tables)) + config.size();
+}
+
+uint64_t PackedIndex::AlignToPage(uint64_t offset, unsigned int page_size) {
+    return (offset + page_size - 1) / page_size * page_size;
+}
+
+void PackedIndex::WriteHeader(std::ofstream& ofs, const Directory& directory) {
+    std::string config = Utils::SerializeQalshConfig(directory.config);
+    auto config_size = static_cast<uint64_t>(config.size());
+
+    ofs.seekp(0, std::ios::beg);
+    ofs.write(reinterpret_cast<const char*>(&kMagic), sizeof(kMagic));
+    ofs.write(reinterpret_cast<const char*>(&config_size), sizeof(config_size));
+    ofs.write(config.data(), static_cast<std::streamsize>(config.size()));
+    ofs.write(reinterpret_cast<const char*>(&directory.dot_vectors_offset), sizeof(directory.dot_vectors_offset));
+    ofs.write(reinterpret_cast<const char*>(directory.tree_offsets.data()),
+              static_cast<std::streamsize>(directory.tree_offsets.size() * sizeof(uint64_t)));
+}
+
+PackedIndex::Directory PackedIndex::ReadHeader(const std::filesystem::path& file_path) {
+    std::ifstream ifs(file_path, std::ios::binary);
+    if (!ifs.is_open()) {
+        spdlog::error("Failed to open packed index file: {}", file_path.string());
+    }
+
+    uint64_t magic = 0;
+    ifs.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    if (magic != kMagic) {
+        spdlog::error("Not a packed index file: {}", file_path.string());
+    }
+
+    uint64_t config_size = 0;
+    ifs.read(reinterpret_cast<char*>(&config_size), sizeof(config_size));
+    std::string config(config_size, '\0');
+    ifs.read(config.data(), static_cast<std::streamsize>(config_size));
+
+    Directory directory;
+    directory.config = Utils::ParseQalshConfig(config);
+    ifs.read(reinterpret_cast<char*>(&directory.dot_vectors_offset), sizeof(directory.dot_vectors_offset));
+    directory.tree_offsets.resize(directory.config.num_hash_tables);
+    ifs.read(reinterpret_cast<char*>(directory.tree_offsets.data()),
+             static_cast<std::streamsize>(directory.tree_offsets.size() * sizeof(uint64_t)));
+
+    return directory;
+}
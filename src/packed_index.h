@@ -0,0 +1,41 @@
+#ifndef PACKED_INDEX_H_
+#define PACKED_INDEX_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+// A packed index keeps the config, the dot vectors and all the B+ trees of a point set in a single file, so that one
+// descriptor serves the whole index. The file starts with a header:
+//
+//   uint64 magic | uint64 config size | config (JSON) | uint64 dot vectors offset | uint64 tree offsets[num_tables]
+//
+// The dot vectors and every tree start on a page boundary, and the page numbers stored in a tree are relative to the
+// offset of the tree.
+class PackedIndex {
+   public:
+    static constexpr const char* kFileName = "index.bin";
+    static constexpr uint64_t kMagic = 0x315844494853414CULL;  // "LASHIDX1"
+
+    struct Directory {
+        QalshConfig config;
+        uint64_t dot_vectors_offset{0};
+        std::vector<uint64_t> tree_offsets;
+    };
+
+    // Whether the index in index_directory is packed.
+    static bool Exists(const std::filesystem::path& index_directory);
+    // Loads the config of the index in index_directory, whether it is packed or not.
+    static QalshConfig LoadConfig(const std::filesystem::path& index_directory);
+
+    static uint64_t GetHeaderSize(const std::string& config, unsigned int num_hash_tables);
+    static uint64_t AlignToPage(uint64_t offset, unsigned int page_size);
+    static void WriteHeader(std::ofstream& ofs, const Directory& directory);
+    static Directory ReadHeader(const std::filesystem::path& file_path);
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include "scalar_quantizer.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "global.h"
+#include "utils.h"
+
+template <typename T>
+void ScalarQuantizer::Train(std::ifstream& base_file, unsigned int num_points, unsigned int num_dimensions) {
+    std::vector<T> mins(num_dimensions, std::numeric_limits<T>::max());
+    std::vector<T> maxs(num_dimensions, std::numeric_limits<T>::lowest());
+
+    for (unsigned int first = 0; first < num_points; first += Global::kQueryBlockSize) {
+        unsigned int block_size = std::min(Global::kQueryBlockSize, num_points - first);
+        PointMatrix<T> points = Utils::ReadPoints<T>(base_file, num_dimensions, first, block_size);
+        for (unsigned int i = 0; i < block_size; i++) {
+            PointView<T> point = Utils::GetPoint(points, i);
+            for (unsigned int j = 0; j < num_dimensions; j++) {
+                mins[j] = std::min(mins[j], point[j]);
+                maxs[j] = std::max(maxs[j], point[j]);
+            }
+        }
+    }
+
+    mins_.resize(num_dimensions);
+    steps_.resize(num_dimensions);
+    for (unsigned int j = 0; j < num_dimensions; j++) {
+        mins_[j] = static_cast<float>(mins[j]);
+        steps_[j] = static_cast<float>((maxs[j] - mins[j]) / (kNumLevels - 1));
+    }
+}
+
+template <typename T>
+void ScalarQuantizer::Encode(PointView<T> point, std::span<uint8_t> code) const {
+    for (size_t j = 0; j < point.size(); j++) {
+        // A constant dimension has a zero step and is always decoded to its minimum.
+        float level = steps_[j] > 0.0F ? std::round((static_cast<float>(point[j]) - mins_[j]) / steps_[j]) : 0.0F;
+        code[j] = static_cast<uint8_t>(std::clamp(level, 0.0F, static_cast<float>(kNumLevels - 1)));
+    }
+}
+
+template <typename T>
+void ScalarQuantizer::ShiftQuery(PointView<T> query_point, std::vector<float>& shifted_query) const {
+    shifted_query.resize(query_point.size());
+    for (size_t j = 0; j < query_point.size(); j++) {
+        shifted_query[j] = static_cast<float>(query_point[j]) - mins_[j];
+    }
+}
+
+double ScalarQuantizer::L1(std::span<const float> shifted_query, std::span<const uint8_t> code) const {
+    float sum = 0.0F;
+    for (size_t j = 0; j < code.size(); j++) {
+        sum += std::abs(shifted_query[j] - steps_[j] * static_cast<float>(code[j]));
+    }
+    return sum;
+}
+
+double ScalarQuantizer::L2(std::span<const float> shifted_query, std::span<const uint8_t> code) const {
+    float sum = 0.0F;
+    for (size_t j = 0; j < code.size(); j++) {
+        float diff = shifted_query[j] - steps_[j] * static_cast<float>(code[j]);
+        sum += diff * diff;
+    }
+    return std::sqrt(static_cast<double>(sum));
+}
+
+void ScalarQuantizer::Save(const std::filesystem::path& file_path) const {
+    std::ofstream ofs(file_path, std::ios::binary);
+    if (!ofs.is_open()) {
+        spdlog::error("Failed to open file for writing: {}", file_path.string());
+    }
+    ofs.write(reinterpret_cast<const char*>(mins_.data()), static_cast<std::streamsize>(mins_.size() * sizeof(float)));
+    ofs.write(reinterpret_cast<const char*>(steps_.data()),
+              static_cast<std::streamsize>(steps_.size() * sizeof(float)));
+}
+
+void ScalarQuantizer::Load(const std::filesystem::path& file_path, unsigned int num_dimensions) {
+    std::ifstream ifs(file_path, std::ios::binary);
+    if (!ifs.is_open()) {
+        spdlog::error("Failed to open quantizer file: {}", file_path.string());
+    }
+    mins_.resize(num_dimensions);
+    steps_.resize(num_dimensions);
+    ifs.read(reinterpret_cast<char*>(mins_.data()), static_cast<std::streamsize>(mins_.size() * sizeof(float)));
+    ifs.read(reinterpret_cast<char*>(steps_.data()), static_cast<std::streamsize>(steps_.size() * sizeof(float)));
+}
+
+template void ScalarQuantizer::Train<float>(std::ifstream& base_file, unsigned int num_points,
+                                            unsigned int num_dimensions);
+template void ScalarQuantizer::Train<double>(std::ifstream& base_file, unsigned int num_points,
+                                             unsigned int num_dimensions);
+template void ScalarQuantizer::Encode<float>(PointView<float> point, std::span<uint8_t> code) const;
+template void ScalarQuantizer::Encode<double>(PointView<double> point, std::span<uint8_t> code) const;
+template void ScalarQuantizer::ShiftQuery<float>(PointView<float> query_point,
+                                                 std::vector<float>& shifted_query) const;
+template void ScalarQuantizer::ShiftQuery<double>(PointView<double> query_point,
+                                                  std::vector<float>& shifted_query) const;
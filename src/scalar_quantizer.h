@@ -0,0 +1,46 @@
+#ifndef SCALAR_QUANTIZER_H_
+#define SCALAR_QUANTIZER_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <vector>
+
+#include "types.h"
+
+class ScalarQuantizer;
+
+using QuantizedDistanceFunction = double (ScalarQuantizer::*)(std::span<const float> shifted_query,
+                                                              std::span<const uint8_t> code) const;
+
+// Int8 scalar quantizer. Each coordinate is mapped to one of 256 evenly spaced levels between the minimum and the
+// maximum of its dimension, so a point is stored in num_dimensions bytes. Queries are not quantized: distances are
+// computed between the shifted query (query - minimum) and the decoded levels.
+class ScalarQuantizer {
+   public:
+    static constexpr unsigned int kNumLevels = 256;
+
+    ScalarQuantizer() = default;
+
+    template <typename T>
+    void Train(std::ifstream& base_file, unsigned int num_points, unsigned int num_dimensions);
+
+    template <typename T>
+    void Encode(PointView<T> point, std::span<uint8_t> code) const;
+
+    template <typename T>
+    void ShiftQuery(PointView<T> query_point, std::vector<float>& shifted_query) const;
+
+    [[nodiscard]] double L1(std::span<const float> shifted_query, std::span<const uint8_t> code) const;
+    [[nodiscard]] double L2(std::span<const float> shifted_query, std::span<const uint8_t> code) const;
+
+    void Save(const std::filesystem::path& file_path) const;
+    void Load(const std::filesystem::path& file_path, unsigned int num_dimensions);
+
+   private:
+    std::vector<float> mins_;
+    std::vector<float> steps_;
+};
+
+#endif
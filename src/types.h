@@ -1,19 +1,34 @@
 #ifndef TYPES_H_
 #define TYPES_H_
 
+#include <Eigen/Core>
 #include <filesystem>
+#include <span>
 #include <vector>
 
+template <typename T>
 struct KeyPageNumPair {
-    double key;
+    T key;
     unsigned int page_num;
 };
 
+template <typename T>
 struct DotProductPointIdPair {
-    double dot_product{0.0};
+    T dot_product{0};
     unsigned int point_id{0};
 };
 
+// Orders pairs by dot product, and pairs with equal dot products by point id, so that every table has a single order.
+struct CompareDotProductPointIdPair {
+    template <typename T>
+    bool operator()(const DotProductPointIdPair<T>& a, const DotProductPointIdPair<T>& b) const {
+        if (a.dot_product != b.dot_product) {
+            return a.dot_product < b.dot_product;
+        }
+        return a.point_id < b.point_id;
+    }
+};
+
 struct AnnResult {
     double distance{0.0};
     unsigned int point_id{0};
@@ -23,7 +38,11 @@ struct CompareAnnResult {
     bool operator()(const AnnResult& a, const AnnResult& b) const { return a.distance > b.distance; }
 };
 
+// Element type of the coordinates stored in a dataset and of everything derived from them (dot vectors, B+ tree keys).
+enum class DataType { kFloat32, kFloat64 };
+
 struct DatasetMetadata {
+    DataType data_type{DataType::kFloat64};
     unsigned int num_points_a{0};
     unsigned int num_points_b{0};
     unsigned int num_dimensions{0};
@@ -31,22 +50,37 @@ struct DatasetMetadata {
     double chamfer_distance_l2{0.0};
 };
 
-using Coordinate = double;
-using Point = std::vector<Coordinate>;
+template <typename T>
+using Point = std::vector<T>;
+
+template <typename T>
+using PointView = std::span<const T>;
+
+// Row-major so that every point is one contiguous, aligned slice of a single allocation.
+template <typename T>
+using PointMatrix = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+template <typename T>
+using PointMatrixRef = Eigen::Ref<const PointMatrix<T>>;
 
 struct PointSetMetadata {
+    DataType data_type{DataType::kFloat64};
     std::filesystem::path file_path;
     unsigned int num_points{0};
     unsigned int num_dimensions{0};
 };
 
 struct QalshConfig {
+    DataType data_type{DataType::kFloat64};
     double approximation_ratio{0.0};
     double bucket_width{0.0};
     double error_probability{0.0};
     unsigned int num_hash_tables{0};
     unsigned int collision_threshold{0};
     unsigned int page_size{0};
+    bool quantized{false};
+    bool compressed_leaves{false};
+    bool reordered{false};
 };
 
 #endif
\ No newline at end of file
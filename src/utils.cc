@@ -1,7 +1,10 @@
 #include "utils.h"
 
+#include <fcntl.h>
 #include <spdlog/spdlog.h>
+#include <sys/stat.h>
 
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <fstream>
@@ -13,27 +16,7 @@
 
 #include "global.h"
 
-double Utils::LpDistance(const Point &pt1, const Point &pt2, double norm_order) {
-    Eigen::Map<const Eigen::VectorXd> v1(pt1.data(), static_cast<Eigen::Index>(pt1.size()));
-    Eigen::Map<const Eigen::VectorXd> v2(pt2.data(), static_cast<Eigen::Index>(pt2.size()));
-
-    if (std::abs(norm_order - 1.0) < Global::kEpsilon) {
-        return static_cast<double>((v1 - v2).lpNorm<1>());
-    }
-    // NOLINTNEXTLINE(readability-magic-numbers)
-    if (std::abs(norm_order - 2.0) < Global::kEpsilon) {
-        return static_cast<double>((v1 - v2).lpNorm<2>());
-    }
-    spdlog::error("Unsupported norm order: {}", norm_order);
-    return 0.0;
-}
-
-double Utils::DotProduct(const Point &pt1, const Point &pt2) {
-    Eigen::Map<const Eigen::VectorXd> v1(pt1.data(), static_cast<Eigen::Index>(pt1.size()));
-    Eigen::Map<const Eigen::VectorXd> v2(pt2.data(), static_cast<Eigen::Index>(pt2.size()));
-
-    return v1.dot(v2);
-}
+NLOHMANN_JSON_SERIALIZE_ENUM(DataType, {{DataType::kFloat64, "float64"}, {DataType::kFloat32, "float32"}})
 
 DatasetMetadata Utils::LoadDatasetMetadata(const std::filesystem::path &file_path) {
     DatasetMetadata metadata;
@@ -45,6 +28,8 @@ DatasetMetadata Utils::LoadDatasetMetadata(const std::filesystem::path &file_pat
     std::ifstream ifs(file_path);
     nlohmann::json json_metadata = nlohmann::json::parse(ifs);
 
+    // Datasets without a data type predate float32 support and are stored as float64.
+    metadata.data_type = json_metadata.value("data_type", DataType::kFloat64);
     json_metadata.at("num_points_a").get_to(metadata.num_points_a);
     json_metadata.at("num_points_b").get_to(metadata.num_points_b);
     json_metadata.at("num_dimensions").get_to(metadata.num_dimensions);
@@ -54,39 +39,6 @@ DatasetMetadata Utils::LoadDatasetMetadata(const std::filesystem::path &file_pat
     return metadata;
 }
 
-std::vector<Point> Utils::LoadPointsFromFile(const std::filesystem::path &file_path, unsigned int num_points,
-                                             unsigned int num_dimensions) {
-    std::ifstream ifs(file_path);
-    if (!ifs.is_open()) {
-        spdlog::error("Could not open base points file: {}", file_path.string());
-        return {};
-    }
-
-    unsigned int total_doubles = num_points * num_dimensions;
-    std::vector<double> buffer(total_doubles);
-    ifs.read(reinterpret_cast<char *>(buffer.data()), static_cast<std::streamoff>(total_doubles * sizeof(Coordinate)));
-
-    std::vector<Point> points;
-    points.reserve(num_points);
-    for (unsigned int i = 0; i < num_points; ++i) {
-        auto start_offset = i * num_dimensions;
-        auto end_offset = start_offset + num_dimensions;
-        auto start_it = buffer.begin() + start_offset;
-        auto end_it = buffer.begin() + end_offset;
-        points.emplace_back(start_it, end_it);
-    }
-
-    return points;
-}
-
-Point Utils::ReadPoint(std::ifstream &ifs, unsigned int num_dimensions, unsigned int point_id) {
-    ifs.seekg(static_cast<std::streamoff>(static_cast<unsigned long>(point_id * num_dimensions) * sizeof(Coordinate)),
-              std::ios::beg);
-    Point point(num_dimensions);
-    ifs.read(reinterpret_cast<char *>(point.data()), static_cast<std::streamoff>(num_dimensions * sizeof(Coordinate)));
-    return point;
-}
-
 // NOLINTBEGIN(readability-magic-numbers)
 void Utils::RegularizeQalshConfig(QalshConfig &config, unsigned int num_points, double norm_order) {
     double beta = Global::kNumCandidates / static_cast<double>(num_points);
@@ -121,22 +73,14 @@ void Utils::RegularizeQalshConfig(QalshConfig &config, unsigned int num_points,
 }
 // NOLINTEND(readability-magic-numbers)
 
-void Utils::SaveQalshConfig(QalshConfig &config, const std::filesystem::path &file_path) {
-    nlohmann::json metadata;
-    metadata["approximation_ratio"] = config.approximation_ratio;
-    metadata["bucket_width"] = config.bucket_width;
-    metadata["error_probability"] = config.error_probability;
-    metadata["num_hash_tables"] = config.num_hash_tables;
-    metadata["collision_threshold"] = config.collision_threshold;
-    metadata["page_size"] = config.page_size;
-
+void Utils::SaveQalshConfig(const QalshConfig &config, const std::filesystem::path &file_path) {
     std::ofstream ofs(file_path);
     if (!ofs.is_open()) {
         spdlog::error("Failed to open file for writing: {}", file_path.string());
         return;
     }
 
-    ofs << metadata.dump(4);
+    ofs << SerializeQalshConfig(config);
 }
 
 QalshConfig Utils::LoadQalshConfig(const std::filesystem::path &file_path) {
@@ -145,15 +89,41 @@ QalshConfig Utils::LoadQalshConfig(const std::filesystem::path &file_path) {
     }
 
     std::ifstream ifs(file_path);
-    nlohmann::json metadata = nlohmann::json::parse(ifs);
+    std::stringstream json;
+    json << ifs.rdbuf();
+    return ParseQalshConfig(json.str());
+}
+
+std::string Utils::SerializeQalshConfig(const QalshConfig &config) {
+    nlohmann::json metadata;
+    metadata["data_type"] = config.data_type;
+    metadata["approximation_ratio"] = config.approximation_ratio;
+    metadata["bucket_width"] = config.bucket_width;
+    metadata["error_probability"] = config.error_probability;
+    metadata["num_hash_tables"] = config.num_hash_tables;
+    metadata["collision_threshold"] = config.collision_threshold;
+    metadata["page_size"] = config.page_size;
+    metadata["quantized"] = config.quantized;
+    metadata["compressed_leaves"] = config.compressed_leaves;
+    metadata["reordered"] = config.reordered;
+
+    return metadata.dump(4);
+}
+
+QalshConfig Utils::ParseQalshConfig(const std::string &json) {
+    nlohmann::json metadata = nlohmann::json::parse(json);
     QalshConfig config;
 
+    config.data_type = metadata.value("data_type", DataType::kFloat64);
     metadata.at("approximation_ratio").get_to(config.approximation_ratio);
     metadata.at("bucket_width").get_to(config.bucket_width);
     metadata.at("error_probability").get_to(config.error_probability);
     metadata.at("num_hash_tables").get_to(config.num_hash_tables);
     metadata.at("collision_threshold").get_to(config.collision_threshold);
     metadata.at("page_size").get_to(config.page_size);
+    config.quantized = metadata.value("quantized", false);
+    config.compressed_leaves = metadata.value("compressed_leaves", false);
+    config.reordered = metadata.value("reordered", false);
 
     return config;
 }
@@ -196,6 +166,14 @@ double Utils::GetMemoryUsage() {
     return static_cast<double>(memory_usage) / 1024.0;  // NOLINT: readability-magic-numbers
 }
 
+unsigned int Utils::GetDirectIoAlignment(const std::filesystem::path &file_path) {
+    struct statx stat {};
+    if (statx(AT_FDCWD, file_path.c_str(), 0, STATX_DIOALIGN, &stat) != 0 || (stat.stx_mask & STATX_DIOALIGN) == 0) {
+        return 0;
+    }
+    return std::max(stat.stx_dio_offset_align, stat.stx_dio_mem_align);
+}
+
 std::mt19937 Utils::CreateSeededGenerator() {
     if (Global::kUseFixedSeed) {
         return std::mt19937(Global::kDefaultSeed);
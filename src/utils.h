@@ -4,27 +4,60 @@
 #include <spdlog/spdlog.h>
 
 #include <Eigen/Eigen>
+#include <fstream>
+#include <limits>
 #include <random>
+#include <string>
+#include <type_traits>
+#include <utility>
 
+#include "distance.h"
 #include "types.h"
 
 class Utils {
    public:
-    static double LpDistance(const Point &pt1, const Point &pt2, double norm_order);
-    static double DotProduct(const Point &pt1, const Point &pt2);
     static DatasetMetadata LoadDatasetMetadata(const std::filesystem::path &file_path);
-    static std::vector<Point> LoadPointsFromFile(const std::filesystem::path &file_path, unsigned int num_points,
-                                                 unsigned int num_dimensions);
-    static Point ReadPoint(std::ifstream &ifs, unsigned int num_dimensions, unsigned int point_id);
     static void RegularizeQalshConfig(QalshConfig &config, unsigned int num_points, double norm_order);
-    static void SaveQalshConfig(QalshConfig &config, const std::filesystem::path &file_path);
+    static void SaveQalshConfig(const QalshConfig &config, const std::filesystem::path &file_path);
     static QalshConfig LoadQalshConfig(const std::filesystem::path &file_path);
+    static std::string SerializeQalshConfig(const QalshConfig &config);
+    static QalshConfig ParseQalshConfig(const std::string &json);
     static unsigned int SampleFromWeights(const std::vector<double> &weights);
     static double GetMemoryUsage();
+    // Returns the alignment in bytes that direct I/O on the file needs for offsets, sizes and buffers, or 0 if the file
+    // system does not support direct I/O on it.
+    static unsigned int GetDirectIoAlignment(const std::filesystem::path &file_path);
     static std::mt19937 CreateSeededGenerator();
     static double CalculateL1Probability(double x);
     static double CalculateL2Probability(double x);
 
+    template <typename T>
+    static double LpDistance(PointView<T> pt1, PointView<T> pt2, double norm_order);
+
+    template <typename T>
+    static T DotProduct(PointView<T> pt1, PointView<T> pt2);
+
+    template <typename T>
+    static PointMatrix<T> LoadPointsFromFile(const std::filesystem::path &file_path, unsigned int num_points,
+                                             unsigned int num_dimensions);
+
+    template <typename T>
+    static PointView<T> GetPoint(const PointMatrix<T> &points, unsigned int point_id);
+
+    template <typename T>
+    static PointView<T> GetPoint(const PointMatrixRef<T> &points, unsigned int point_id);
+
+    template <typename T>
+    static Point<T> ReadPoint(std::ifstream &ifs, unsigned int num_dimensions, unsigned int point_id);
+
+    template <typename T>
+    static PointMatrix<T> ReadPoints(std::ifstream &ifs, unsigned int num_dimensions, unsigned int first_point_id,
+                                     unsigned int num_points);
+
+    // Calls func with std::type_identity<T>{}, where T is the scalar type that stores data_type.
+    template <typename Func>
+    static decltype(auto) VisitDataType(DataType data_type, Func &&func);
+
     template <typename T>
     static T ReadFromBuffer(const std::vector<char> &buffer, size_t &offset);
 
@@ -35,6 +68,74 @@ class Utils {
     static void WriteToBuffer(std::vector<char> &buffer, size_t &offset, const T &data);
 };
 
+template <typename T>
+double Utils::LpDistance(PointView<T> pt1, PointView<T> pt2, double norm_order) {
+    return Distance<T>::Get(norm_order)(pt1, pt2, std::numeric_limits<double>::max());
+}
+
+template <typename T>
+T Utils::DotProduct(PointView<T> pt1, PointView<T> pt2) {
+    using Vector = Eigen::Matrix<T, Eigen::Dynamic, 1>;
+    Eigen::Map<const Vector> v1(pt1.data(), static_cast<Eigen::Index>(pt1.size()));
+    Eigen::Map<const Vector> v2(pt2.data(), static_cast<Eigen::Index>(pt2.size()));
+
+    return v1.dot(v2);
+}
+
+template <typename T>
+PointMatrix<T> Utils::LoadPointsFromFile(const std::filesystem::path &file_path, unsigned int num_points,
+                                         unsigned int num_dimensions) {
+    std::ifstream ifs(file_path, std::ios::binary);
+    if (!ifs.is_open()) {
+        spdlog::error("Could not open base points file: {}", file_path.string());
+        return {};
+    }
+
+    // The file is already laid out row-major, so it can be read straight into the matrix storage.
+    PointMatrix<T> points(num_points, num_dimensions);
+    ifs.read(reinterpret_cast<char *>(points.data()),
+             static_cast<std::streamoff>(static_cast<size_t>(num_points) * num_dimensions * sizeof(T)));
+
+    return points;
+}
+
+template <typename T>
+PointView<T> Utils::GetPoint(const PointMatrix<T> &points, unsigned int point_id) {
+    return {points.row(point_id).data(), static_cast<size_t>(points.cols())};
+}
+
+template <typename T>
+PointView<T> Utils::GetPoint(const PointMatrixRef<T> &points, unsigned int point_id) {
+    return {points.row(point_id).data(), static_cast<size_t>(points.cols())};
+}
+
+template <typename T>
+Point<T> Utils::ReadPoint(std::ifstream &ifs, unsigned int num_dimensions, unsigned int point_id) {
+    ifs.seekg(static_cast<std::streamoff>(static_cast<size_t>(point_id) * num_dimensions * sizeof(T)), std::ios::beg);
+    Point<T> point(num_dimensions);
+    ifs.read(reinterpret_cast<char *>(point.data()), static_cast<std::streamoff>(num_dimensions * sizeof(T)));
+    return point;
+}
+
+template <typename T>
+PointMatrix<T> Utils::ReadPoints(std::ifstream &ifs, unsigned int num_dimensions, unsigned int first_point_id,
+                                 unsigned int num_points) {
+    ifs.seekg(static_cast<std::streamoff>(static_cast<size_t>(first_point_id) * num_dimensions * sizeof(T)),
+              std::ios::beg);
+    PointMatrix<T> points(num_points, num_dimensions);
+    ifs.read(reinterpret_cast<char *>(points.data()),
+             static_cast<std::streamoff>(static_cast<size_t>(num_points) * num_dimensions * sizeof(T)));
+    return points;
+}
+
+template <typename Func>
+decltype(auto) Utils::VisitDataType(DataType data_type, Func &&func) {
+    if (data_type == DataType::kFloat32) {
+        return std::forward<Func>(func)(std::type_identity<float>{});
+    }
+    return std::forward<Func>(func)(std::type_identity<double>{});
+}
+
 template <typename T>
 T Utils::ReadFromBuffer(const std::vector<char> &buffer, size_t &offset) {
     if (offset + sizeof(T) > buffer.size()) {
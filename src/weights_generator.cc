@@ -2,6 +2,7 @@
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <filesystem>
 #include <format>
 #include <fstream>
@@ -9,6 +10,8 @@
 #include <vector>
 
 #include "ann_searcher.h"
+#include "global.h"
+#include "mapped_point_set.h"
 #include "utils.h"
 
 // --------------------------------------------------
@@ -27,7 +30,7 @@ std::vector<double> UniformWeightsGenerator::Generate(const PointSetMetadata& fr
 // --------------------------------------------------
 InMemoryQalshWeightsGenerator::InMemoryQalshWeightsGenerator(double approximation_ratio)
     : approximation_ratio_(approximation_ratio),
-      ann_searcher_(std::make_unique<InMemoryQalshAnnSearcher>(approximation_ratio_)) {}
+      ann_searcher_factory_(AnnSearcherFactory::Of<InMemoryQalshAnnSearcher>(approximation_ratio_)) {}
 
 std::vector<double> InMemoryQalshWeightsGenerator::Generate(const PointSetMetadata& from_metadata,
                                                             const PointSetMetadata& to_metadata, double norm_order,
@@ -50,14 +53,25 @@ std::vector<double> InMemoryQalshWeightsGenerator::Generate(const PointSetMetada
 
     // Generate weights based on QALSH algorithm.
     spdlog::info("Generating weights using QALSH (In Memory)...");
-    ann_searcher_->Init(to_metadata, norm_order);
-
-    std::vector<Point> base_points =
-        Utils::LoadPointsFromFile(from_metadata.file_path, from_metadata.num_points, from_metadata.num_dimensions);
-
-    for (unsigned int i = 0; i < from_metadata.num_points; i++) {
-        weights[i] = ann_searcher_->Search(base_points[i]).distance;
-    }
+    Utils::VisitDataType(to_metadata.data_type, [&](auto type) {
+        using T = typename decltype(type)::type;
+        std::unique_ptr<AnnSearcher<T>> ann_searcher = ann_searcher_factory_.Create<T>();
+        ann_searcher->Init(to_metadata, norm_order);
+        std::unique_ptr<typename AnnSearcher<T>::Context> context = ann_searcher->CreateContext();
+
+        PointMatrix<T> base_points = Utils::LoadPointsFromFile<T>(from_metadata.file_path, from_metadata.num_points,
+                                                                  from_metadata.num_dimensions);
+
+        for (unsigned int first = 0; first < from_metadata.num_points; first += Global::kQueryBlockSize) {
+            unsigned int block_size = std::min(Global::kQueryBlockSize, from_metadata.num_points - first);
+            std::vector<AnnResult> results =
+                ann_searcher->SearchBatch(base_points.middleRows(first, block_size), *context);
+            for (unsigned int i = 0; i < block_size; i++) {
+                weights[first + i] = results[i].distance;
+            }
+        }
+        ann_searcher->LogStatistics();
+    });
 
     if (use_cache) {
         std::ofstream ofs(weights_path);
@@ -71,7 +85,8 @@ std::vector<double> InMemoryQalshWeightsGenerator::Generate(const PointSetMetada
 // --------------------------------------------------
 // DiskQalshWeightsGenerator Implementation
 // --------------------------------------------------
-DiskQalshWeightsGenerator::DiskQalshWeightsGenerator() : ann_searcher_(std::make_unique<DiskQalshAnnSearcher>()) {}
+DiskQalshWeightsGenerator::DiskQalshWeightsGenerator(unsigned int num_pinned_levels, bool direct_io)
+    : ann_searcher_factory_(AnnSearcherFactory::Of<DiskQalshAnnSearcher>(num_pinned_levels, direct_io)) {}
 
 std::vector<double> DiskQalshWeightsGenerator::Generate(const PointSetMetadata& from_metadata,
                                                         const PointSetMetadata& to_metadata, double norm_order,
@@ -95,17 +110,25 @@ std::vector<double> DiskQalshWeightsGenerator::Generate(const PointSetMetadata&
     // Generate weights based on QALSH algorithm.
     spdlog::info("Generating weights using QALSH (Disk)...");
 
-    ann_searcher_->Init(to_metadata, norm_order);
-
-    std::ifstream base_file(from_metadata.file_path, std::ios::binary);
-    if (!base_file.is_open()) {
-        spdlog::error("Failed to open base file: {}", from_metadata.file_path.string());
-        return {};
-    }
-
-    for (unsigned int i = 0; i < from_metadata.num_points; i++) {
-        weights[i] = ann_searcher_->Search(Utils::ReadPoint(base_file, from_metadata.num_dimensions, i)).distance;
-    }
+    Utils::VisitDataType(to_metadata.data_type, [&](auto type) {
+        using T = typename decltype(type)::type;
+        MappedPointSet<T> query_points;
+        query_points.Open(from_metadata, AccessPattern::kSequential);
+
+        std::unique_ptr<AnnSearcher<T>> ann_searcher = ann_searcher_factory_.Create<T>();
+        ann_searcher->Init(to_metadata, norm_order);
+        std::unique_ptr<typename AnnSearcher<T>::Context> context = ann_searcher->CreateContext();
+
+        for (unsigned int first = 0; first < from_metadata.num_points; first += Global::kQueryBlockSize) {
+            unsigned int block_size = std::min(Global::kQueryBlockSize, from_metadata.num_points - first);
+            std::vector<AnnResult> results =
+                ann_searcher->SearchBatch(query_points.GetPoints(first, block_size), *context);
+            for (unsigned int i = 0; i < block_size; i++) {
+                weights[first + i] = results[i].distance;
+            }
+        }
+        ann_searcher->LogStatistics();
+    });
 
     if (use_cache) {
         std::ofstream ofs(weights_path);
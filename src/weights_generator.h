@@ -4,6 +4,7 @@
 #include <vector>
 
 #include "ann_searcher.h"
+#include "global.h"
 #include "types.h"
 
 // --------------------------------------------------
@@ -37,7 +38,7 @@ class InMemoryQalshWeightsGenerator : public WeightsGenerator {
 
    private:
     double approximation_ratio_;
-    std::unique_ptr<AnnSearcher> ann_searcher_;
+    AnnSearcherFactory ann_searcher_factory_;
 };
 
 // --------------------------------------------------
@@ -45,12 +46,13 @@ class InMemoryQalshWeightsGenerator : public WeightsGenerator {
 // --------------------------------------------------
 class DiskQalshWeightsGenerator : public WeightsGenerator {
    public:
-    DiskQalshWeightsGenerator();
+    DiskQalshWeightsGenerator(unsigned int num_pinned_levels = Global::kDefaultNumPinnedLevels,
+                              bool direct_io = false);
     std::vector<double> Generate(const PointSetMetadata& from_metadata, const PointSetMetadata& to_metadata,
                                  double norm_order, bool use_cache) override;
 
    private:
-    std::unique_ptr<AnnSearcher> ann_searcher_;
+    AnnSearcherFactory ann_searcher_factory_;
 };
 
 #endif
\ No newline at end of file